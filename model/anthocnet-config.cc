@@ -58,6 +58,12 @@ TypeId AntHocNetConfig::GetTypeId() {
     MakeTimeAccessor(&AntHocNetConfig::rtable_update_interval),
     MakeTimeChecker()
   )
+  .AddAttribute ("RTableUpdateSlice",
+    "Number of destinations the RoutingTable update visits at once.",
+    UintegerValue(32),
+    MakeUintegerAccessor(&AntHocNetConfig::rtable_update_slice),
+    MakeUintegerChecker<uint32_t>(1)
+  )
   .AddAttribute ("ProactiveAntTimer",
     "The interval, in which an active session sends out proactive ants",
     TimeValue (MilliSeconds(1000)),
@@ -70,6 +76,12 @@ TypeId AntHocNetConfig::GetTypeId() {
     MakeTimeAccessor(&AntHocNetConfig::nb_expire),
     MakeTimeChecker()
   )
+  .AddAttribute ("NeighborExpireGranularity",
+    "Neighbors expire in batches, at most this much later than NeighborExpire.",
+    TimeValue (MilliSeconds(100)),
+    MakeTimeAccessor(&AntHocNetConfig::nb_expire_granularity),
+    MakeTimeChecker()
+  )
   .AddAttribute ("SessionExpire",
     "Time without outbound traffic, after a session is considered over",
     TimeValue (Seconds(10)),
@@ -82,12 +94,110 @@ TypeId AntHocNetConfig::GetTypeId() {
     MakeTimeAccessor(&AntHocNetConfig::dcache_expire),
     MakeTimeChecker()
   )
+  .AddAttribute ("DataCacheMaxPackets",
+    "Maximum number of cached data packets per destination, 0 for no limit",
+    UintegerValue(64),
+    MakeUintegerAccessor(&AntHocNetConfig::dcache_max_packets),
+    MakeUintegerChecker<uint32_t>()
+  )
+  .AddAttribute ("DataCacheMaxBytes",
+    "Maximum number of cached data bytes per destination, 0 for no limit",
+    UintegerValue(0),
+    MakeUintegerAccessor(&AntHocNetConfig::dcache_max_bytes),
+    MakeUintegerChecker<uint32_t>()
+  )
+  .AddAttribute ("DataCacheNodeMaxPackets",
+    "Maximum number of cached data packets of this node, 0 for no limit",
+    UintegerValue(256),
+    MakeUintegerAccessor(&AntHocNetConfig::dcache_node_max_packets),
+    MakeUintegerChecker<uint32_t>()
+  )
+  .AddAttribute ("DataCacheNodeMaxBytes",
+    "Maximum number of cached data bytes of this node, 0 for no limit",
+    UintegerValue(0),
+    MakeUintegerAccessor(&AntHocNetConfig::dcache_node_max_bytes),
+    MakeUintegerChecker<uint32_t>()
+  )
+  .AddAttribute ("DataCacheDropPolicy",
+    "Which packet is dropped, if the data cache is full",
+    EnumValue(CACHE_DROP_OLDEST),
+    MakeEnumAccessor(&AntHocNetConfig::dcache_drop_policy),
+    MakeEnumChecker(CACHE_DROP_OLDEST, "DropOldest",
+                    CACHE_DROP_NEWEST, "DropNewest",
+                    CACHE_DROP_LOWEST_PRIORITY, "DropLowestPriority")
+  )
+  .AddAttribute ("DataCachePacing",
+    "Release cached data in batches instead of all at once, when a route is found",
+    BooleanValue(false),
+    MakeBooleanAccessor(&AntHocNetConfig::dcache_pacing),
+    MakeBooleanChecker()
+  )
+  .AddAttribute ("DataCacheBatchSize",
+    "Number of cached packets released at once, if pacing is enabled",
+    UintegerValue(4),
+    MakeUintegerAccessor(&AntHocNetConfig::dcache_batch_size),
+    MakeUintegerChecker<uint32_t>(1)
+  )
+  .AddAttribute ("DataCachePacingMin",
+    "Minimum time between two batches of cached packets",
+    TimeValue (MilliSeconds(1)),
+    MakeTimeAccessor(&AntHocNetConfig::dcache_pacing_min),
+    MakeTimeChecker()
+  )
+  .AddAttribute ("DataCachePacingMax",
+    "Maximum time between two batches of cached packets",
+    TimeValue (MilliSeconds(50)),
+    MakeTimeAccessor(&AntHocNetConfig::dcache_pacing_max),
+    MakeTimeChecker()
+  )
+  .AddAttribute ("MacCacheExpire",
+    "Time a resolved mac address is reused before the arp caches are asked again",
+    TimeValue (Seconds(1)),
+    MakeTimeAccessor(&AntHocNetConfig::mac_cache_expire),
+    MakeTimeChecker()
+  )
   .AddAttribute ("NoBroadcast",
     "Time after broadcast,where no broadcast is allowed to same destination",
     TimeValue (MilliSeconds(100)),
     MakeTimeAccessor(&AntHocNetConfig::no_broadcast),
     MakeTimeChecker()
   )
+  .AddAttribute ("DiscoveryBackoff",
+    "Time until the first retry of a route discovery, doubled with every retry",
+    TimeValue (MilliSeconds(200)),
+    MakeTimeAccessor(&AntHocNetConfig::discovery_backoff),
+    MakeTimeChecker()
+  )
+  .AddAttribute ("DiscoveryMaxBackoff",
+    "Maximum time between two retries of a route discovery",
+    TimeValue (Seconds(2)),
+    MakeTimeAccessor(&AntHocNetConfig::discovery_max_backoff),
+    MakeTimeChecker()
+  )
+  .AddAttribute ("DiscoveryMaxRetries",
+    "Retries of a route discovery before the cached data is dropped",
+    UintegerValue(4),
+    MakeUintegerAccessor(&AntHocNetConfig::discovery_max_retries),
+    MakeUintegerChecker<uint32_t>()
+  )
+  .AddAttribute ("HistoryWindow",
+    "Number of recent ant sequence numbers remembered per source",
+    UintegerValue(256),
+    MakeUintegerAccessor(&AntHocNetConfig::history_window),
+    MakeUintegerChecker<uint32_t>(1)
+  )
+  .AddAttribute ("HistoryExpire",
+    "Time without ants from a source, after its history is forgotten",
+    TimeValue (Seconds(30)),
+    MakeTimeAccessor(&AntHocNetConfig::history_expire),
+    MakeTimeChecker()
+  )
+  .AddAttribute ("HistoryMaxSources",
+    "Maximum number of sources kept in the ant history",
+    UintegerValue(1024),
+    MakeUintegerAccessor(&AntHocNetConfig::history_max_sources),
+    MakeUintegerChecker<uint32_t>(1)
+  )
   .AddAttribute("AlphaTMac",
     "The alpha value of the running average of T_mac.",
     DoubleValue(0.7),
@@ -106,6 +216,12 @@ TypeId AntHocNetConfig::GetTypeId() {
     MakeDoubleAccessor(&AntHocNetConfig::alpha),
     MakeDoubleChecker<double>()
   )
+  .AddAttribute("EvaporationInterval",
+    "Pheromone evaporates by alpha once per interval. Zero disables evaporation",
+    TimeValue (Seconds(0)),
+    MakeTimeAccessor(&AntHocNetConfig::evaporation_interval),
+    MakeTimeChecker()
+  )
   .AddAttribute("Gamma",
     "The pheromone uses a running average with a decay defined by gamma",
     DoubleValue(0.7),
@@ -154,6 +270,30 @@ TypeId AntHocNetConfig::GetTypeId() {
     MakeUintegerAccessor(&AntHocNetConfig::initial_ttl),
     MakeUintegerChecker<uint8_t>()
   )
+  .AddAttribute("ExpandingRing",
+    "If set true, reactive forward ants search in rings of growing TTL",
+    BooleanValue(false),
+    MakeBooleanAccessor(&AntHocNetConfig::expanding_ring),
+    MakeBooleanChecker()
+  )
+  .AddAttribute("TtlStart",
+    "The TTL of the first ring of a route discovery",
+    UintegerValue(2),
+    MakeUintegerAccessor(&AntHocNetConfig::ttl_start),
+    MakeUintegerChecker<uint8_t>(1)
+  )
+  .AddAttribute("TtlIncrement",
+    "The growth of the TTL from one ring to the next",
+    UintegerValue(2),
+    MakeUintegerAccessor(&AntHocNetConfig::ttl_increment),
+    MakeUintegerChecker<uint8_t>(1)
+  )
+  .AddAttribute("TtlThreshold",
+    "The largest ring. Beyond it, the ants are sent with InitialTTL",
+    UintegerValue(7),
+    MakeUintegerAccessor(&AntHocNetConfig::ttl_threshold),
+    MakeUintegerChecker<uint8_t>()
+  )
   .AddAttribute("ReactiveBroadcastTTL",
     "The number of times, a reactive ant can be broadcasted",
     UintegerValue(10),
@@ -205,6 +345,30 @@ TypeId AntHocNetConfig::GetTypeId() {
     MakeDoubleAccessor(&AntHocNetConfig::trust_threshold),
     MakeDoubleChecker<double>()
   )
+  .AddAttribute ("TrustTtl",
+    "Time a trust value is reused, unless the statistic of the neighbor changes",
+    TimeValue (MilliSeconds(100)),
+    MakeTimeAccessor(&AntHocNetConfig::trust_ttl),
+    MakeTimeChecker()
+  )
+  .AddAttribute ("WatchdogSampling",
+    "Fraction of the forwarded data packets, that are watched for replay",
+    DoubleValue(1.0),
+    MakeDoubleAccessor(&AntHocNetConfig::watchdog_sampling),
+    MakeDoubleChecker<double>(0.001, 1.0)
+  )
+  .AddAttribute ("WatchdogAdaptive",
+    "Watch all packets of a neighbor, whose fullfillment rate is low",
+    BooleanValue(false),
+    MakeBooleanAccessor(&AntHocNetConfig::watchdog_adaptive),
+    MakeBooleanChecker()
+  )
+  .AddAttribute ("WatchdogAdaptiveThreshold",
+    "Fullfillment rate, below which adaptive sampling watches all packets",
+    DoubleValue(0.9),
+    MakeDoubleAccessor(&AntHocNetConfig::watchdog_adaptive_threshold),
+    MakeDoubleChecker<double>(0.0, 1.0)
+  )
   
   ;
   return tid;
@@ -229,19 +393,40 @@ void AntHocNetConfig::Print(std::ostream& os) const {
   
   os << "hello_interval: " << hello_interval << std::endl;
   os << "rtable_update_interval: " << rtable_update_interval << std::endl;
+  os << "rtable_update_slice: " << rtable_update_slice << std::endl;
   os << "pr_ant_interval: " << pr_ant_interval << std::endl;
   
   os << "nb_expire: " << nb_expire << std::endl;
+  os << "nb_expire_granularity: " << nb_expire_granularity << std::endl;
   os << "session_expire: " << session_expire << std::endl;
   os << "dcache_expire: " << dcache_expire << std::endl;
+  os << "mac_cache_expire: " << mac_cache_expire << std::endl;
+  
+  os << "dcache_max_packets: " << dcache_max_packets << std::endl;
+  os << "dcache_max_bytes: " << dcache_max_bytes << std::endl;
+  os << "dcache_node_max_packets: " << dcache_node_max_packets << std::endl;
+  os << "dcache_node_max_bytes: " << dcache_node_max_bytes << std::endl;
+  os << "dcache_drop_policy: " << dcache_drop_policy << std::endl;
+  os << "dcache_pacing: " << dcache_pacing << std::endl;
+  os << "dcache_batch_size: " << dcache_batch_size << std::endl;
+  os << "dcache_pacing_min: " << dcache_pacing_min << std::endl;
+  os << "dcache_pacing_max: " << dcache_pacing_max << std::endl;
   
   os << "no_broadcast: " << no_broadcast << std::endl;
+  os << "discovery_backoff: " << discovery_backoff << std::endl;
+  os << "discovery_max_backoff: " << discovery_max_backoff << std::endl;
+  os << "discovery_max_retries: " << discovery_max_retries << std::endl;
+  
+  os << "history_window: " << history_window << std::endl;
+  os << "history_expire: " << history_expire << std::endl;
+  os << "history_max_sources: " << history_max_sources << std::endl;
   
   os << "alpha_T_mac: " << alpha_T_mac << std::endl;
   os << "T_hop: " << T_hop << std::endl;
   
   os << "alpha: " << alpha << std::endl;
   os << "gamma: " << gamma << std::endl;
+  os << "evaporation_interval: " << evaporation_interval << std::endl;
   
   os << "prog_beta: " << prog_beta << std::endl;
   os << "cons_beta: " << cons_beta << std::endl;
@@ -251,6 +436,10 @@ void AntHocNetConfig::Print(std::ostream& os) const {
   os << "eta_value: " << eta_value << std::endl;
   
   os << "initial_ttl: " << initial_ttl << std::endl;
+  os << "expanding_ring: " << expanding_ring << std::endl;
+  os << "ttl_start: " << (uint32_t) ttl_start << std::endl;
+  os << "ttl_increment: " << (uint32_t) ttl_increment << std::endl;
+  os << "ttl_threshold: " << (uint32_t) ttl_threshold << std::endl;
   
   os << "reactive_bcast_count: " << reactive_bcast_count << std::endl;
   os << "proactive_bcast_count: " << proactive_bcast_count << std::endl;
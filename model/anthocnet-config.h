@@ -29,6 +29,7 @@
 
 #include "ns3/boolean.h"
 #include "ns3/double.h"
+#include "ns3/enum.h"
 #include "ns3/integer.h"
 #include "ns3/uinteger.h"
 #include "ns3/pointer.h"
@@ -38,6 +39,13 @@
 namespace ns3 {
 namespace ahn {
 
+// What is dropped, if the data cache is full
+typedef enum CacheDropPolicy {
+  CACHE_DROP_OLDEST,
+  CACHE_DROP_NEWEST,
+  CACHE_DROP_LOWEST_PRIORITY
+} cache_drop_policy_t;
+
 class AntHocNetConfig : public Object {
 public:
   // ctor
@@ -67,16 +75,44 @@ public:
   // Intervals of Timer events
   Time hello_interval;
   Time rtable_update_interval;
+  uint32_t rtable_update_slice;
   Time pr_ant_interval;
   
   // Timeout of Rtable information
   Time nb_expire;
+  Time nb_expire_granularity;
   Time session_expire;
   Time dcache_expire;
+  
+  // Limits of the data cache per destination and per node, 0 disables
+  uint32_t dcache_max_packets;
+  uint32_t dcache_max_bytes;
+  uint32_t dcache_node_max_packets;
+  uint32_t dcache_node_max_bytes;
+  cache_drop_policy_t dcache_drop_policy;
+  
+  // Release cached data in batches, spaced by the send time of the next hop
+  bool dcache_pacing;
+  uint32_t dcache_batch_size;
+  Time dcache_pacing_min;
+  Time dcache_pacing_max;
+  
+  Time mac_cache_expire;
   // Time after a broadcast, in which no other broadcast to 
   // same destination is allowed.
   Time no_broadcast;
   
+  // Retries of a reactive route discovery, the backoff doubles
+  // with every retry
+  Time discovery_backoff;
+  Time discovery_max_backoff;
+  uint32_t discovery_max_retries;
+  
+  // Duplicate ant detection
+  uint32_t history_window;
+  Time history_expire;
+  uint32_t history_max_sources;
+  
   
   // ---------------------------------
   // Pheromone calculation
@@ -87,6 +123,9 @@ public:
   double alpha;
   double gamma;
   
+  // Pheromone evaporates by alpha every evaporation_interval
+  Time evaporation_interval;
+  
   double prog_beta;
   double cons_beta;
   
@@ -101,6 +140,14 @@ public:
   // Misc
   uint8_t initial_ttl;
   
+  // Expanding ring search of reactive forward ants.
+  // The TTL grows by ttl_increment from ttl_start, and jumps
+  // to initial_ttl once it exceeds ttl_threshold.
+  bool expanding_ring;
+  uint8_t ttl_start;
+  uint8_t ttl_increment;
+  uint8_t ttl_threshold;
+  
   uint8_t reactive_bcast_count;
   uint8_t proactive_bcast_count;
   
@@ -117,6 +164,12 @@ public:
   Ptr<AntHocNetFis> fis;
   bool fuzzy_mode;
   double trust_threshold;
+  Time trust_ttl;
+  
+  // Fraction of the forwarded packets, that are watched
+  double watchdog_sampling;
+  bool watchdog_adaptive;
+  double watchdog_adaptive_threshold;
 };
 
 }  
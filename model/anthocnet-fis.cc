@@ -16,15 +16,106 @@
  */
 
 #include <string>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 #include "anthocnet-fis.h"
 
+#ifdef ANTHOCNET_WITH_FUZZYLITE
+#include "fl/Headers.h"
 using namespace fl;
+#endif
 
 namespace ns3 {
 NS_LOG_COMPONENT_DEFINE ("AntHocNetRoutingFis");
 namespace ahn{  
 
-AntHocNetFis::AntHocNetFis() {
+// Number of centroid samples over the output range,
+// the same as the default of fuzzylite
+#define FIS_RESOLUTION 100
+
+double FisMf::Eval(double x) const {
+  
+  switch (this->type) {
+    case TRAPMF:
+      if (x < this->p[0] || x > this->p[3])
+        return 0;
+      if (x < this->p[1])
+        return (x - this->p[0]) / (this->p[1] - this->p[0]);
+      if (x <= this->p[2])
+        return 1;
+      if (x < this->p[3])
+        return (this->p[3] - x) / (this->p[3] - this->p[2]);
+      return 0;
+    
+    case TRIMF:
+      if (x < this->p[0] || x > this->p[2])
+        return 0;
+      if (x < this->p[1])
+        return (x - this->p[0]) / (this->p[1] - this->p[0]);
+      if (x == this->p[1])
+        return 1;
+      if (x < this->p[2])
+        return (this->p[2] - x) / (this->p[2] - this->p[1]);
+      return 0;
+    
+    case GAUSSMF:
+      // Parameters are [sigma mean]
+      return std::exp(-(x - this->p[1]) * (x - this->p[1])
+        / (2 * this->p[0] * this->p[0]));
+  }
+  return 0;
+}
+
+// Removes whitespace and quotes around a value
+static std::string FisTrim(const std::string& str) {
+  
+  size_t begin = str.find_first_not_of(" \t\r'");
+  if (begin == std::string::npos)
+    return "";
+  size_t end = str.find_last_not_of(" \t\r'");
+  return str.substr(begin, end - begin + 1);
+}
+
+// Parses a list of numbers "[a b c]"
+static std::vector<double> FisParams(const std::string& str) {
+  
+  std::vector<double> params;
+  size_t begin = str.find('[');
+  size_t end = str.find(']', begin);
+  if (begin == std::string::npos || end == std::string::npos)
+    return params;
+  
+  std::istringstream is(str.substr(begin + 1, end - begin - 1));
+  double value;
+  while (is >> value)
+    params.push_back(value);
+  
+  return params;
+}
+
+AntHocNetFis::AntHocNetFis() :
+  use_fuzzylite(false),
+  ready(false),
+  use_lookup(false),
+  lookup_resolution(128),
+  lookup_cells(0),
+  lookup_error(0),
+  min1(0), max1(1),
+  min2(0), max2(1),
+  and_prod(false),
+  or_probor(false),
+  imp_prod(false),
+  out_mfs(0),
+  resolution(FIS_RESOLUTION),
+  engine(0),
+  input1(0),
+  input2(0),
+  output(0)
+{
 }
 
 AntHocNetFis::~AntHocNetFis() {}
@@ -43,6 +134,25 @@ TypeId AntHocNetFis::GetTypeId() {
     MakeStringAccessor(&AntHocNetFis::fis_file),
     MakeStringChecker()
   )
+  .AddAttribute ("UseFuzzylite",
+    "If true, fuzzylite is used instead of the native inference engine. "
+    "Requires the module to be configured with --with-fuzzylite",
+    BooleanValue(false),
+    MakeBooleanAccessor(&AntHocNetFis::use_fuzzylite),
+    MakeBooleanChecker()
+  )
+  .AddAttribute ("UseLookupTable",
+    "If true, the inference system is sampled once and interpolated afterwards",
+    BooleanValue(false),
+    MakeBooleanAccessor(&AntHocNetFis::use_lookup),
+    MakeBooleanChecker()
+  )
+  .AddAttribute ("LookupResolution",
+    "Number of cells of the lookup table per input",
+    UintegerValue(128),
+    MakeUintegerAccessor(&AntHocNetFis::lookup_resolution),
+    MakeUintegerChecker<uint32_t>(1)
+  )
   ;
   return tid;
 }
@@ -50,26 +160,442 @@ TypeId AntHocNetFis::GetTypeId() {
 
 
 void AntHocNetFis::Init() {
-  this->engine = FisImporter().fromFile(this->fis_file);
   
-  std::string status;
-  if (!engine->isReady(&status)) {
-    NS_LOG_ERROR("Fis file could not be loaded");
+  if (this->use_fuzzylite) {
+#ifdef ANTHOCNET_WITH_FUZZYLITE
+    try {
+      this->engine = FisImporter().fromFile(this->fis_file);
+    }
+    catch (fl::Exception& e) {
+      NS_LOG_ERROR("Fis file " << this->fis_file << " could not be loaded: " << e.what());
+      this->ready = false;
+      return;
+    }
+    
+    std::string status;
+    if (!this->engine->isReady(&status)
+      || this->engine->numberOfInputVariables() < 2
+      || this->engine->numberOfOutputVariables() < 1) {
+      NS_LOG_ERROR("Fis file " << this->fis_file << " could not be loaded: " << status);
+      this->ready = false;
+      return;
+    }
+    
+    this->input1 = this->engine->getInputVariable(0);
+    this->input2 = this->engine->getInputVariable(1);
+    
+    this->output = this->engine->getOutputVariable(0);
+    
+    this->min1 = this->input1->getMinimum();
+    this->max1 = this->input1->getMaximum();
+    this->min2 = this->input2->getMinimum();
+    this->max2 = this->input2->getMaximum();
+    this->ready = true;
+#else
+    NS_LOG_ERROR("Module was built without fuzzylite, using the native engine");
+    this->use_fuzzylite = false;
+#endif
   }
   
-  this->input1 = this->engine->getInputVariable(0);
-  this->input2 = this->engine->getInputVariable(1);
+  if (!this->use_fuzzylite) {
+    this->ready = this->LoadFis();
+    if (!this->ready) {
+      NS_LOG_ERROR("Fis file " << this->fis_file << " could not be loaded");
+      return;
+    }
+    
+    this->min1 = this->in_min[0];
+    this->max1 = this->in_max[0];
+    this->min2 = this->in_min[1];
+    this->max2 = this->in_max[1];
+  }
   
-  this->output = this->engine->getOutputVariable(0);
+  if (this->use_lookup)
+    this->BuildLookupTable();
 }
 
 double AntHocNetFis::Eval(double in1, double in2) {
   
-  this->input1->setValue(in1);
-  this->input2->setValue(in2);
-  this->engine->process();
+  // Without a loaded fis, there is no table and the engine returns NaN
+  if (this->use_lookup && this->ready && !this->lookup.empty()) {
+    double out = this->EvalLookupTable(in1, in2);
+    
+    // A grid point without any active rule is NaN and spoils 
+    // the cells around it, the engine is used within these cells
+    if (!std::isnan(out))
+      return out;
+  }
+  
+  return this->EvalEngine(in1, in2);
+}
+
+double AntHocNetFis::GetLookupError() const {
+  return this->lookup_error;
+}
+
+double AntHocNetFis::EvalEngine(double in1, double in2) {
+  
+  if (!this->ready)
+    return std::numeric_limits<double>::quiet_NaN();
+  
+#ifdef ANTHOCNET_WITH_FUZZYLITE
+  if (this->use_fuzzylite) {
+    this->input1->setValue(in1);
+    this->input2->setValue(in2);
+    this->engine->process();
+    
+    return this->output->getValue();
+  }
+#endif
+  
+  return this->EvalNative(in1, in2);
+}
+
+bool AntHocNetFis::LoadFis() {
+  
+  std::ifstream file(this->fis_file.c_str());
+  if (!file.is_open())
+    return false;
+  
+  enum {NONE, SYSTEM, INPUT, OUTPUT, RULES} section = NONE;
+  std::vector<std::vector<FisMf> > inputs;
+  std::vector<FisMf> outputs;
+  uint32_t num_outputs = 0;
+  double out_min = 0, out_max = 1;
+  bool ok = true;
+  
+  this->rule_ante.clear();
+  this->rule_cons.clear();
+  this->rule_weight.clear();
+  this->rule_or.clear();
+  
+  std::string line;
+  while (std::getline(file, line)) {
+    line = FisTrim(line);
+    if (line.empty() || line[0] == '%' || line[0] == '#')
+      continue;
+    
+    if (line[0] == '[') {
+      if (line.compare(0, 8, "[System]") == 0) {
+        section = SYSTEM;
+      }
+      else if (line.compare(0, 6, "[Input") == 0) {
+        section = INPUT;
+        inputs.push_back(std::vector<FisMf>());
+      }
+      else if (line.compare(0, 7, "[Output") == 0) {
+        section = OUTPUT;
+        num_outputs++;
+      }
+      else if (line.compare(0, 7, "[Rules]") == 0) {
+        section = RULES;
+      }
+      else {
+        section = NONE;
+      }
+      continue;
+    }
+    
+    if (section == RULES) {
+      // Format is "a b, c (weight) : connection"
+      size_t comma = line.find(',');
+      size_t open = line.find('(', comma);
+      size_t close = line.find(')', open);
+      size_t colon = line.find(':', close);
+      if (comma == std::string::npos || open == std::string::npos
+        || close == std::string::npos || colon == std::string::npos) {
+        NS_LOG_ERROR("Malformed rule " << line);
+        ok = false;
+        continue;
+      }
+      
+      std::istringstream ante(line.substr(0, comma));
+      int32_t index;
+      uint32_t count = 0;
+      while (ante >> index) {
+        this->rule_ante.push_back(index);
+        count++;
+      }
+      
+      std::istringstream cons(line.substr(comma + 1, open - comma - 1));
+      cons >> index;
+      if (count != inputs.size() || index < 1) {
+        NS_LOG_ERROR("Unsupported rule " << line);
+        ok = false;
+        this->rule_ante.resize(this->rule_ante.size() - count);
+        continue;
+      }
+      this->rule_cons.push_back(index - 1);
+      
+      this->rule_weight.push_back(
+        std::atof(line.substr(open + 1, close - open - 1).c_str()));
+      this->rule_or.push_back(
+        std::atoi(line.substr(colon + 1).c_str()) == 2);
+      continue;
+    }
+    
+    size_t eq = line.find('=');
+    if (eq == std::string::npos)
+      continue;
+    std::string key = FisTrim(line.substr(0, eq));
+    std::string value = FisTrim(line.substr(eq + 1));
+    
+    if (section == SYSTEM) {
+      if (key == "Type" && value != "mamdani") {
+        NS_LOG_ERROR("Unsupported fis type " << value);
+        ok = false;
+      }
+      else if (key == "AndMethod") {
+        this->and_prod = (value == "prod");
+        ok = ok && (value == "min" || value == "prod");
+      }
+      else if (key == "OrMethod") {
+        this->or_probor = (value == "probor");
+        ok = ok && (value == "max" || value == "probor");
+      }
+      else if (key == "ImpMethod") {
+        this->imp_prod = (value == "prod");
+        ok = ok && (value == "min" || value == "prod");
+      }
+      else if (key == "AggMethod" && value != "max") {
+        NS_LOG_ERROR("Unsupported aggregation " << value);
+        ok = false;
+      }
+      else if (key == "DefuzzMethod" && value != "centroid") {
+        NS_LOG_ERROR("Unsupported defuzzification " << value);
+        ok = false;
+      }
+      continue;
+    }
+    
+    if (section != INPUT && section != OUTPUT)
+      continue;
+    
+    if (key == "Range") {
+      std::vector<double> range = FisParams(value);
+      if (range.size() != 2) {
+        ok = false;
+        continue;
+      }
+      if (section == INPUT) {
+        this->in_min.resize(inputs.size(), 0);
+        this->in_max.resize(inputs.size(), 1);
+        this->in_min.back() = range[0];
+        this->in_max.back() = range[1];
+      }
+      else {
+        out_min = range[0];
+        out_max = range[1];
+      }
+    }
+    else if (key.compare(0, 2, "MF") == 0) {
+      // Format is 'name':'type',[params]
+      size_t colon = value.find(':');
+      size_t bracket = value.find('[');
+      if (colon == std::string::npos || bracket == std::string::npos) {
+        ok = false;
+        continue;
+      }
+      std::string type = FisTrim(value.substr(colon + 1, bracket - colon - 1));
+      if (!type.empty() && type[type.size() - 1] == ',')
+        type = FisTrim(type.substr(0, type.size() - 1));
+      std::vector<double> params = FisParams(value);
+      
+      FisMf mf;
+      std::fill(mf.p, mf.p + 4, 0.0);
+      if (type == "trapmf" && params.size() == 4) {
+        mf.type = FisMf::TRAPMF;
+      }
+      else if (type == "trimf" && params.size() == 3) {
+        mf.type = FisMf::TRIMF;
+      }
+      else if (type == "gaussmf" && params.size() == 2) {
+        mf.type = FisMf::GAUSSMF;
+      }
+      else {
+        NS_LOG_ERROR("Unsupported membership function " << value);
+        ok = false;
+        continue;
+      }
+      std::copy(params.begin(), params.end(), mf.p);
+      
+      if (section == INPUT)
+        inputs.back().push_back(mf);
+      else
+        outputs.push_back(mf);
+    }
+  }
+  
+  if (!ok || inputs.size() != 2 || num_outputs != 1 
+    || this->in_min.size() != 2 || this->rule_cons.empty())
+    return false;
+  
+  // Flatten the inputs and check the rules against them
+  this->in_mfs.clear();
+  this->in_offset.clear();
+  for (uint32_t i = 0; i < inputs.size(); i++) {
+    this->in_offset.push_back(this->in_mfs.size());
+    this->in_mfs.insert(this->in_mfs.end(), inputs[i].begin(), inputs[i].end());
+  }
+  
+  for (uint32_t r = 0; r < this->rule_cons.size(); r++) {
+    if (this->rule_cons[r] >= outputs.size())
+      return false;
+    for (uint32_t i = 0; i < inputs.size(); i++) {
+      int32_t index = this->rule_ante[r * inputs.size() + i];
+      if ((uint32_t) std::abs(index) > inputs[i].size())
+        return false;
+    }
+  }
+  
+  // Sample the output functions on the centroid grid
+  this->out_mfs = outputs.size();
+  this->out_x.resize(this->resolution);
+  this->out_samples.resize(this->resolution * this->out_mfs);
+  double dx = (out_max - out_min) / this->resolution;
+  for (uint32_t k = 0; k < this->resolution; k++) {
+    this->out_x[k] = out_min + (k + 0.5) * dx;
+    for (uint32_t t = 0; t < this->out_mfs; t++) {
+      this->out_samples[k * this->out_mfs + t] = outputs[t].Eval(this->out_x[k]);
+    }
+  }
+  
+  this->in_degree.resize(this->in_mfs.size());
+  this->activation.resize(this->out_mfs);
+  
+  NS_LOG_INFO("Loaded " << this->fis_file << " with " 
+    << this->rule_cons.size() << " rules");
+  return true;
+}
+
+double AntHocNetFis::EvalNative(double in1, double in2) {
+  
+  // Membership degrees of all input functions
+  double in[2] = {in1, in2};
+  for (uint32_t i = 0; i < 2; i++) {
+    uint32_t end = (i + 1 < this->in_offset.size()) ? 
+      this->in_offset[i + 1] : this->in_mfs.size();
+    for (uint32_t m = this->in_offset[i]; m < end; m++)
+      this->in_degree[m] = this->in_mfs[m].Eval(in[i]);
+  }
+  
+  // With max aggregation, only the strongest activation
+  // of every output function matters
+  std::fill(this->activation.begin(), this->activation.end(), 0.0);
+  for (uint32_t r = 0; r < this->rule_cons.size(); r++) {
+    
+    bool use_or = this->rule_or[r];
+    double degree = use_or ? 0 : 1;
+    for (uint32_t i = 0; i < 2; i++) {
+      int32_t index = this->rule_ante[r * 2 + i];
+      if (index == 0)
+        continue;
+      
+      double value = this->in_degree[this->in_offset[i] + std::abs(index) - 1];
+      if (index < 0)
+        value = 1 - value;
+      
+      if (use_or)
+        degree = this->or_probor ? 
+          degree + value - degree * value : std::max(degree, value);
+      else
+        degree = this->and_prod ? 
+          degree * value : std::min(degree, value);
+    }
+    degree *= this->rule_weight[r];
+    
+    double& act = this->activation[this->rule_cons[r]];
+    act = std::max(act, degree);
+  }
+  
+  // Centroid of the aggregated output
+  double area = 0;
+  double moment = 0;
+  const double* sample = &this->out_samples[0];
+  for (uint32_t k = 0; k < this->resolution; k++) {
+    double y = 0;
+    for (uint32_t t = 0; t < this->out_mfs; t++) {
+      double value = this->imp_prod ? 
+        sample[t] * this->activation[t] : std::min(sample[t], this->activation[t]);
+      y = std::max(y, value);
+    }
+    area += y;
+    moment += y * this->out_x[k];
+    sample += this->out_mfs;
+  }
+  
+  if (area == 0)
+    return std::numeric_limits<double>::quiet_NaN();
+  
+  return moment / area;
+}
+
+void AntHocNetFis::BuildLookupTable() {
+  
+  uint32_t n = this->lookup_resolution;
+  this->lookup_cells = n;
+  double step1 = (this->max1 - this->min1) / n;
+  double step2 = (this->max2 - this->min2) / n;
+  
+  // Sample the grid points
+  this->lookup.resize((n + 1) * (n + 1));
+  for (uint32_t i = 0; i <= n; i++) {
+    for (uint32_t j = 0; j <= n; j++) {
+      this->lookup[i * (n + 1) + j] = 
+        this->EvalEngine(this->min1 + i * step1, this->min2 + j * step2);
+    }
+  }
+  
+  // The interpolation is worst away from the grid points. The error is
+  // sampled on a 4x4 grid within every cell, including the cell edges.
+  // It is an estimate, the error between the samples can be larger.
+  uint32_t sub = 4;
+  this->lookup_error = 0;
+  for (uint32_t i = 0; i <= n * sub; i++) {
+    for (uint32_t j = 0; j <= n * sub; j++) {
+      // The grid points are exact
+      if (i % sub == 0 && j % sub == 0)
+        continue;
+      
+      double in1 = this->min1 + i * step1 / sub;
+      double in2 = this->min2 + j * step2 / sub;
+      
+      // Eval uses the engine, where either one is NaN
+      double engine = this->EvalEngine(in1, in2);
+      double table = this->EvalLookupTable(in1, in2);
+      if (std::isnan(engine) || std::isnan(table))
+        continue;
+      
+      double error = std::fabs(engine - table);
+      if (error > this->lookup_error)
+        this->lookup_error = error;
+    }
+  }
+  
+  NS_LOG_INFO("Fis lookup table " << n << "x" << n 
+    << " max error " << this->lookup_error);
+}
+
+double AntHocNetFis::EvalLookupTable(double in1, double in2) const {
+  
+  uint32_t n = this->lookup_cells;
+  
+  // Position in the grid, inputs are clamped to their range
+  double x = (in1 - this->min1) / (this->max1 - this->min1) * n;
+  double y = (in2 - this->min2) / (this->max2 - this->min2) * n;
+  x = std::min(std::max(x, 0.0), (double) n);
+  y = std::min(std::max(y, 0.0), (double) n);
+  
+  uint32_t i = std::min((uint32_t) x, n - 1);
+  uint32_t j = std::min((uint32_t) y, n - 1);
+  double fx = x - i;
+  double fy = y - j;
+  
+  const double* row0 = &this->lookup[i * (n + 1) + j];
+  const double* row1 = row0 + (n + 1);
   
-  return this->output->getValue();;
+  return (1 - fx) * ((1 - fy) * row0[0] + fy * row0[1])
+    + fx * ((1 - fy) * row1[0] + fy * row1[1]);
 }
 
 void AntHocNetFis::DoDispose() {
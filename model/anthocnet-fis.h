@@ -17,7 +17,9 @@
 #ifndef ANTHOCNET_FIS_H
 #define ANTHOCNET_FIS_H
 
-#include "fl/Headers.h"
+#include <string>
+#include <vector>
+
 #include "ns3/log.h"
 #include "ns3/object.h"
 #include "ns3/attribute.h"
@@ -25,11 +27,28 @@
 #include "ns3/boolean.h"
 #include "ns3/double.h"
 #include "ns3/string.h"
+#include "ns3/uinteger.h"
 
-using namespace fl;
+// The fuzzylite backend is optional, only its .cc file needs the headers
+namespace fl {
+class Engine;
+class InputVariable;
+class OutputVariable;
+}
 
 namespace ns3 {
 namespace ahn {
+
+// Membership function of the native inference system,
+// the parameters are in the order of the .fis file
+struct FisMf {
+  enum Type {TRAPMF, TRIMF, GAUSSMF};
+  
+  Type type;
+  double p[4];
+  
+  double Eval(double x) const;
+};
   
 class AntHocNetFis : public Object{
 public:
@@ -39,6 +58,11 @@ public:
   void Init();
   double Eval(double in1, double in2);
   
+  // Largest difference between the lookup table and the engine,
+  // sampled at the cell centers and edge midpoints during Init.
+  // This is an estimate, the error between the samples can be larger.
+  double GetLookupError() const;
+  
   static TypeId GetTypeId();
   //void Print(std::ostream& os) const;
   
@@ -48,12 +72,66 @@ protected:
   
 private:
   
+  // Runs the full inference
+  double EvalEngine(double in1, double in2);
+  
+  // Parses the .fis file into the flat tables below
+  bool LoadFis();
+  double EvalNative(double in1, double in2);
+  
+  void BuildLookupTable();
+  double EvalLookupTable(double in1, double in2) const;
+  
   std::string fis_file;
+  bool use_fuzzylite;
+  bool ready;
+  
+  // Optionally, the engine is sampled on a grid over the input ranges
+  // and Eval interpolates bilinear between the grid points
+  bool use_lookup;
+  uint32_t lookup_resolution;
+  uint32_t lookup_cells;
+  double lookup_error;
+  
+  double min1, max1;
+  double min2, max2;
+  std::vector<double> lookup;
+  
+  // The native engine supports the subset of the .fis format we use:
+  // two inputs, one output, trapmf/trimf/gaussmf, min or prod as
+  // and/implication, max as aggregation and centroid defuzzification
+  bool and_prod;
+  bool or_probor;
+  bool imp_prod;
+  
+  // Membership functions of all inputs, in_offset[i] is the index of
+  // the first function of input i
+  std::vector<FisMf> in_mfs;
+  std::vector<uint32_t> in_offset;
+  std::vector<double> in_min;
+  std::vector<double> in_max;
+  
+  // Rule r uses rule_ante[r * inputs + i] as antecedent of input i,
+  // 0 means don't care and negative numbers mean "not"
+  std::vector<int32_t> rule_ante;
+  std::vector<uint32_t> rule_cons;
+  std::vector<double> rule_weight;
+  std::vector<bool> rule_or;
+  
+  // The output functions are sampled once on the centroid grid
+  uint32_t out_mfs;
+  uint32_t resolution;
+  std::vector<double> out_x;
+  std::vector<double> out_samples;
+  
+  // Scratch space, so that EvalNative does not allocate
+  std::vector<double> in_degree;
+  std::vector<double> activation;
   
-  Engine* engine;
-  InputVariable* input1;
-  InputVariable* input2;
-  OutputVariable* output;
+  fl::Engine* engine;
+  fl::InputVariable* input1;
+  fl::InputVariable* input2;
+  fl::OutputVariable* output;
 };
 
 // End of namespaces
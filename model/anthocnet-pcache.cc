@@ -17,12 +17,17 @@
 
 #include "anthocnet-pcache.h"
 
+#include <algorithm>
+
 namespace ns3 {
 NS_LOG_COMPONENT_DEFINE ("AntHocNetPCache");
 namespace ahn {
   
 PacketCache::PacketCache(Ptr<AntHocNetConfig> config):
-  config(config)
+  config(config),
+  total_packets(0),
+  total_bytes(0),
+  expiry_timer(Timer::CANCEL_ON_DESTROY)
   {}
   
 PacketCache::~PacketCache() {}
@@ -35,48 +40,333 @@ Ptr<AntHocNetConfig> PacketCache::GetConfig() {
   return this->config;
 }
 
+void PacketCache::SetDropCallback(Callback<void, CacheEntry, std::string> cb) {
+  this->drop_cb = cb;
+}
+
+// True, if count packets of bytes size would exceed the limits
+static bool CacheExceeds(uint32_t count, uint64_t bytes, 
+                         uint32_t max_packets, uint32_t max_bytes) {
+  return (max_packets != 0 && count > max_packets)
+    || (max_bytes != 0 && bytes > max_bytes);
+}
+
 void PacketCache::CachePacket(Ipv4Address dst, CacheEntry ce, Time expire) {
   
   ce.received_in = Simulator::Now();
   ce.expire_in = Simulator::Now() + expire;
+  ce.size = ce.packet->GetSize() + ce.header.GetSerializedSize();
+  
+  // A packet, that exceeds a limit on its own, would empty
+  // the cache without ever fitting in
+  if (CacheExceeds(1, ce.size, 
+      this->config->dcache_max_packets, this->config->dcache_max_bytes)
+    || CacheExceeds(1, ce.size, 
+      this->config->dcache_node_max_packets, this->config->dcache_node_max_bytes)) {
+    if (!this->drop_cb.IsNull())
+      this->drop_cb(ce, "Cache full");
+    return;
+  }
   
-  std::map<Ipv4Address, std::list<CacheEntry> >::iterator it = this->cache.find(dst);
+  dst_cache_t& dc = this->cache[dst];
   
-  if (it == this->cache.end()) {
-    std::list<CacheEntry> v;
-    v.push_back(ce);
-    this->cache.insert(std::make_pair(dst, v));
+  // Make room within the destination, then within the node
+  while (CacheExceeds(dc.live + 1, dc.bytes + ce.size,
+    this->config->dcache_max_packets, this->config->dcache_max_bytes)) {
+    if (!this->Evict(&dc, dst, ce)) {
+      if (!this->drop_cb.IsNull())
+        this->drop_cb(ce, "Cache full");
+      return;
+    }
+  }
+  
+  while (CacheExceeds(this->total_packets + 1, this->total_bytes + ce.size,
+    this->config->dcache_node_max_packets, this->config->dcache_node_max_bytes)) {
+    if (!this->Evict(0, dst, ce)) {
+      if (!this->drop_cb.IsNull())
+        this->drop_cb(ce, "Cache full");
+      return;
+    }
+  }
+  
+  // Push the expiry before the slot is filled, a rebuild of the heap 
+  // would include the new packet otherwise
+  cache_expiry_t ex;
+  ex.expire_in = ce.expire_in;
+  ex.dst = dst;
+  ex.seqno = dc.next_seqno;
+  this->PushExpiry(ex);
+  
+  if (dc.count == dc.ring.size())
+    this->GrowRing(dc);
+  
+  cache_slot_t& slot = dc.At(dc.count);
+  slot.flow = this->RefFlow(dc, ce);
+  slot.packet = std::move(ce.packet);
+  slot.header = std::move(ce.header);
+  slot.type = ce.type;
+  slot.iface = ce.iface;
+  slot.received_in = ce.received_in;
+  slot.expire_in = ce.expire_in;
+  slot.size = ce.size;
+  slot.seqno = dc.next_seqno++;
+  
+  dc.count++;
+  dc.live++;
+  dc.bytes += ce.size;
+  this->total_packets++;
+  this->total_bytes += ce.size;
+  
+  this->ScheduleExpiry();
+  
+  NS_LOG_FUNCTION(this << "to dst" << dst
+    << "expires at:" << ce.expire_in.GetSeconds() << "new size" << dc.live);
+}
+
+uint32_t PacketCache::RefFlow(dst_cache_t& dst, const CacheEntry& ce) {
+  
+  uint32_t unused = dst.flows.size();
+  
+  for (uint32_t i = 0; i < dst.flows.size(); i++) {
+    cache_flow_t& flow = dst.flows[i];
     
-    NS_LOG_FUNCTION(this << "to dst" << dst
-      << "expires at:" << ce.expire_in.GetSeconds() << "new size" << 1);
+    if (flow.refs == 0) {
+      unused = std::min(unused, i);
+      continue;
+    }
+    
+    if (flow.ucb.IsEqual(ce.ucb) && flow.ecb.IsEqual(ce.ecb)) {
+      flow.refs++;
+      return i;
+    }
   }
-  else {
-    it->second.push_back(ce);
-    NS_LOG_FUNCTION(this << "to dst" << dst
-    << "expires at:" << ce.expire_in.GetSeconds() << "new size" << it->second.size());
+  
+  if (unused == dst.flows.size())
+    dst.flows.push_back(cache_flow_t());
+  
+  cache_flow_t& flow = dst.flows[unused];
+  flow.ucb = ce.ucb;
+  flow.ecb = ce.ecb;
+  flow.refs = 1;
+  return unused;
+}
+
+void PacketCache::GrowRing(dst_cache_t& dst) {
+  
+  std::vector<cache_slot_t> ring(std::max<size_t>(4, 2 * dst.ring.size()));
+  for (uint32_t i = 0; i < dst.count; i++) {
+    ring[i] = std::move(dst.At(i));
+  }
+  
+  dst.ring.swap(ring);
+  dst.head = 0;
+}
+
+CacheEntry PacketCache::Take(dst_cache_t& dst, uint32_t pos) {
+  
+  cache_slot_t& slot = dst.At(pos);
+  cache_flow_t& flow = dst.flows[slot.flow];
+  
+  CacheEntry ce;
+  ce.type = slot.type;
+  ce.iface = slot.iface;
+  ce.header = std::move(slot.header);
+  ce.packet = std::move(slot.packet);
+  ce.ucb = flow.ucb;
+  ce.ecb = flow.ecb;
+  ce.received_in = slot.received_in;
+  ce.expire_in = slot.expire_in;
+  ce.size = slot.size;
+  
+  // The slot becomes a hole
+  slot.packet = 0;
+  
+  if (--flow.refs == 0) {
+    flow.ucb.Nullify();
+    flow.ecb.Nullify();
+  }
+  
+  dst.live--;
+  dst.bytes -= ce.size;
+  this->total_packets--;
+  this->total_bytes -= ce.size;
+  
+  // Skip the holes at the front
+  while (dst.count > 0 && dst.At(0).packet == 0) {
+    dst.head = (dst.head + 1) % dst.ring.size();
+    dst.count--;
+  }
+  
+  return ce;
+}
+
+bool PacketCache::Evict(dst_cache_t* dst, Ipv4Address dst_addr, 
+                        const CacheEntry& incoming) {
+  
+  cache_drop_policy_t policy = this->config->dcache_drop_policy;
+  if (policy == CACHE_DROP_NEWEST)
+    return false;
+  
+  // Search the victim in the destination or in all destinations.
+  // Within a destination, the oldest packets are in front.
+  dst_cache_t* victim_dst = 0;
+  Ipv4Address victim_addr;
+  uint32_t victim = 0;
+  
+  for (auto dst_it = this->cache.begin(); dst_it != this->cache.end(); ++dst_it) {
+    dst_cache_t& dc = (dst != 0) ? *dst : dst_it->second;
+    Ipv4Address addr = (dst != 0) ? dst_addr : dst_it->first;
+    
+    if (policy == CACHE_DROP_OLDEST) {
+      // The front is never a hole
+      if (dc.count > 0 && (victim_dst == 0 
+        || dc.At(0).received_in < victim_dst->At(victim).received_in)) {
+        victim_dst = &dc;
+        victim_addr = addr;
+        victim = 0;
+      }
+    }
+    else {
+      for (uint32_t i = 0; i < dc.count; i++) {
+        cache_slot_t& slot = dc.At(i);
+        if (slot.packet == 0)
+          continue;
+        
+        if (victim_dst == 0 
+          || slot.header.GetTos() < victim_dst->At(victim).header.GetTos()
+          || (slot.header.GetTos() == victim_dst->At(victim).header.GetTos() 
+            && slot.received_in < victim_dst->At(victim).received_in)) {
+          victim_dst = &dc;
+          victim_addr = addr;
+          victim = i;
+        }
+      }
+    }
+    
+    if (dst != 0)
+      break;
+  }
+  
+  if (victim_dst == 0)
+    return false;
+  
+  // The incoming packet has the lowest priority itself
+  if (policy == CACHE_DROP_LOWEST_PRIORITY 
+    && incoming.header.GetTos() < victim_dst->At(victim).header.GetTos())
+    return false;
+  
+  this->Drop(victim_addr, *victim_dst, victim, "Cache full");
+  return true;
+}
+
+void PacketCache::Drop(Ipv4Address dst_addr, dst_cache_t& dst, 
+                       uint32_t pos, std::string reason) {
+  
+  CacheEntry ce = this->Take(dst, pos);
+  
+  NS_LOG_FUNCTION(this << "dropped" << ce.packet << "to" << dst_addr << reason);
+  if (!this->drop_cb.IsNull())
+    this->drop_cb(ce, reason);
+}
+
+void PacketCache::PushExpiry(const cache_expiry_t& ex) {
+  
+  // Stale entries are only removed, when they reach the top.
+  // If they pile up, rebuild the heap from the cached packets.
+  if (this->expiry.size() > 2 * this->total_packets + 64) {
+    this->expiry.clear();
+    
+    for (auto it = this->cache.begin(); it != this->cache.end(); ++it) {
+      for (uint32_t i = 0; i < it->second.count; i++) {
+        cache_slot_t& slot = it->second.At(i);
+        if (slot.packet == 0)
+          continue;
+        
+        cache_expiry_t live;
+        live.expire_in = slot.expire_in;
+        live.dst = it->first;
+        live.seqno = slot.seqno;
+        this->expiry.push_back(live);
+      }
+    }
+    
+    std::make_heap(this->expiry.begin(), this->expiry.end(), 
+                   std::greater<cache_expiry_t>());
   }
   
+  this->expiry.push_back(ex);
+  std::push_heap(this->expiry.begin(), this->expiry.end(), 
+                 std::greater<cache_expiry_t>());
+}
+
+void PacketCache::ScheduleExpiry() {
+  
+  if (this->expiry.empty())
+    return;
+  
+  // Only reschedule, if the earliest expiry moved forward. 
+  // If entries got removed, the timer might fire without anything to drop.
+  Time next = this->expiry.front().expire_in;
+  if (this->expiry_timer.IsRunning()
+    && Simulator::Now() + this->expiry_timer.GetDelayLeft() <= next)
+    return;
+  
+  this->expiry_timer.Cancel();
+  this->expiry_timer.SetFunction(&PacketCache::ExpiryTimerExpire, this);
+  this->expiry_timer.Schedule(std::max(next - Simulator::Now(), Seconds(0)));
+}
+
+void PacketCache::ExpiryTimerExpire() {
+  
+  while (!this->expiry.empty() 
+    && this->expiry.front().expire_in <= Simulator::Now()) {
+    
+    cache_expiry_t ex = this->expiry.front();
+    std::pop_heap(this->expiry.begin(), this->expiry.end(), 
+                  std::greater<cache_expiry_t>());
+    this->expiry.pop_back();
+    
+    // Skip packets, that have left the cache already
+    auto it = this->cache.find(ex.dst);
+    if (it == this->cache.end())
+      continue;
+    
+    dst_cache_t& dc = it->second;
+    uint64_t front_seqno = dc.next_seqno - dc.count;
+    if (ex.seqno < front_seqno || ex.seqno >= dc.next_seqno)
+      continue;
+    
+    uint32_t pos = ex.seqno - front_seqno;
+    if (dc.At(pos).packet == 0)
+      continue;
+    
+    NS_LOG_FUNCTION(this << "expired packet to" << ex.dst
+      << "expired at" << ex.expire_in.GetSeconds());
+    this->Drop(ex.dst, dc, pos, "Cached and expired");
+  }
+  
+  this->ScheduleExpiry();
 }
 
 
 void PacketCache::CachePacket(Ipv4Address dst, CacheEntry ce) {
-  this->CachePacket(dst, ce, this->config->dcache_expire);
+  this->CachePacket(dst, std::move(ce), this->config->dcache_expire);
 }
 
 
 bool PacketCache::HasEntries(Ipv4Address dst) {
   
-  std::map<Ipv4Address, std::list<CacheEntry> >::iterator it = this->cache.find(dst);
+  std::map<Ipv4Address, dst_cache_t>::iterator it = this->cache.find(dst);
   if (it == this->cache.end()) {
     // Destination does not exist
     return false;
   }
   
-  if (it->second.size() == 0) {
+  if (it->second.live == 0) {
       return false;
   }
   
-  NS_LOG_FUNCTION(this << "entries" << it->second.size());
+  NS_LOG_FUNCTION(this << "entries" << it->second.live);
   
   return true;
 }
@@ -84,15 +374,14 @@ bool PacketCache::HasEntries(Ipv4Address dst) {
 std::pair<bool, CacheEntry> PacketCache::GetCacheEntry(Ipv4Address dst) {
   
   
-  std::map<Ipv4Address, std::list<CacheEntry> >::iterator it = this->cache.find(dst);
+  std::map<Ipv4Address, dst_cache_t>::iterator it = this->cache.find(dst);
   
-  if (it == this->cache.end()) {  
+  if (it == this->cache.end() || it->second.live == 0) {  
     return std::make_pair(false, CacheEntry());
   }
   
   
-  CacheEntry ce = it->second.front();
-  it->second.pop_front();
+  CacheEntry ce = this->Take(it->second, 0);
   
   //Time T = now - ce.received_in;
   
@@ -112,7 +401,7 @@ std::pair<bool, CacheEntry> PacketCache::GetCacheEntry(Ipv4Address dst) {
 std::vector<Ipv4Address> PacketCache::GetDestinations() {
     std::vector<Ipv4Address> retv;
     
-    for (std::map<Ipv4Address, std::list<CacheEntry> >::iterator it = this->cache.begin();
+    for (std::map<Ipv4Address, dst_cache_t>::iterator it = this->cache.begin();
       it != this->cache.end(); ++it) {
       
       retv.push_back(it->first);
@@ -121,11 +410,16 @@ std::vector<Ipv4Address> PacketCache::GetDestinations() {
     return retv;
 }
 
-void PacketCache::RemoveCache(Ipv4Address dst) {
-    
-    std::map<Ipv4Address, std::list<CacheEntry> >::iterator it = this->cache.find(dst);
-    it->second.clear();
-    
+void PacketCache::DropCache(Ipv4Address dst, std::string reason) {
+  
+  std::map<Ipv4Address, dst_cache_t>::iterator it = this->cache.find(dst);
+  if (it == this->cache.end())
+    return;
+  
+  // The front is never a hole
+  while (it->second.live > 0) {
+    this->Drop(dst, it->second, 0, reason);
+  }
 }
 
 
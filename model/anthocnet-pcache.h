@@ -23,15 +23,22 @@
 
 #include "ns3/node.h"
 #include "ns3/log.h"
+#include "ns3/timer.h"
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/ipv4-interface.h"
 #include "ns3/ipv4-l3-protocol.h"
 #include "ns3/output-stream-wrapper.h"
 
 #include <stdint.h>
+#include <string>
 #include <vector>
+#include <list>
+#include <functional>
 #include <map>
 
+// Inspects the rings of the cache
+class AnthocnetCacheRingTestCase;
+
 namespace ns3 {
 namespace ahn {
   
@@ -50,7 +57,73 @@ struct CacheEntry {
   Time received_in;
   Time expire_in;
   
+  // Bytes accounted for this entry in the cache limits
+  uint32_t size;
 };
+
+// A cached packet in the ring of its destination.
+// The callbacks are stored once per flow, see cache_flow_t.
+typedef struct CacheSlot {
+  CacheSlot() : type(), iface(0), flow(0), size(0), seqno(0) {}
+  
+  // Null, if the packet was taken out of the middle of the ring
+  Ptr<const Packet> packet;
+  Ipv4Header header;
+  mtype_t type;
+  uint32_t iface;
+  uint32_t flow;
+  
+  Time received_in;
+  Time expire_in;
+  uint32_t size;
+  uint64_t seqno;
+} cache_slot_t;
+
+// Callbacks shared by all cached packets with the same callbacks
+typedef struct CacheFlow {
+  CacheFlow() : refs(0) {}
+  
+  Ipv4RoutingProtocol::UnicastForwardCallback ucb;
+  Ipv4RoutingProtocol::ErrorCallback ecb;
+  uint32_t refs;
+} cache_flow_t;
+
+// The cached packets of one destination, oldest first.
+// The ring keeps its storage when it is drained, such that the
+// packets of the next route discovery do not need to allocate.
+// Packets evicted from the middle leave a hole, which is skipped 
+// when it reaches the front.
+typedef struct DstCache {
+  DstCache() : head(0), count(0), live(0), next_seqno(0), bytes(0) {}
+  
+  // Slot i, counted from the front
+  cache_slot_t& At(uint32_t i) { return ring[(head + i) % ring.size()]; }
+  
+  std::vector<cache_slot_t> ring;
+  uint32_t head;
+  // Used slots including the holes, and the packets among them
+  uint32_t count;
+  uint32_t live;
+  // Sequence number of the next packet. The front slot 
+  // has the sequence number next_seqno - count.
+  uint64_t next_seqno;
+  uint64_t bytes;
+  
+  std::vector<cache_flow_t> flows;
+} dst_cache_t;
+
+// Position of a cached packet in the expiry heap.
+// Entries of packets which have left the cache stay in the heap,
+// they are recognized by the sequence number.
+typedef struct CacheExpiry {
+  Time expire_in;
+  Ipv4Address dst;
+  uint64_t seqno;
+  
+  bool operator>(const CacheExpiry& other) const {
+    return this->expire_in > other.expire_in;
+  }
+} cache_expiry_t;
   
 class PacketCache {
 public:
@@ -59,6 +132,7 @@ public:
   //dtor
   ~PacketCache();
 
+// The entry is moved into the cache, pass it with std::move
 void CachePacket(Ipv4Address dst, CacheEntry ce, Time expire);
 void CachePacket(Ipv4Address dst, CacheEntry ce);
 
@@ -67,17 +141,55 @@ std::pair<bool, CacheEntry> GetCacheEntry(Ipv4Address dst);
 
 std::vector<Ipv4Address> GetDestinations();
 
-void RemoveCache(Ipv4Address dst);
+// Drops all packets to dst through the drop callback
+void DropCache(Ipv4Address dst, std::string reason);
 
 void SetConfig(Ptr<AntHocNetConfig>);
 Ptr<AntHocNetConfig> GetConfig();
 
+// Called for every packet, that the cache drops to stay in its limits
+void SetDropCallback(Callback<void, CacheEntry, std::string> cb);
+
 private:
+  friend class ::AnthocnetCacheRingTestCase;
+  
+  // Drops one packet of dst, or of the whole node if dst is null,
+  // according to the drop policy. Returns false, if the incoming 
+  // packet should be dropped instead.
+  bool Evict(dst_cache_t* dst, Ipv4Address dst_addr, const CacheEntry& incoming);
+  void Drop(Ipv4Address dst_addr, dst_cache_t& dst, 
+            uint32_t pos, std::string reason);
+  
+  // Takes the packet at pos out of the ring and updates the accounting
+  CacheEntry Take(dst_cache_t& dst, uint32_t pos);
+  
+  // Finds or adds the flow of the callbacks, returns its index
+  uint32_t RefFlow(dst_cache_t& dst, const CacheEntry& ce);
+  
+  // Doubles the ring, keeping the order of the slots
+  void GrowRing(dst_cache_t& dst);
+  
+  // Adds the packet to the expiry heap, rebuilding the heap
+  // if the stale entries dominate
+  void PushExpiry(const cache_expiry_t& ex);
+  
+  // A single timer drops the expired packets of all destinations
+  void ScheduleExpiry();
+  void ExpiryTimerExpire();
   
   // Configuration of the packet cache
   Ptr<AntHocNetConfig> config;
   
-  std::map<Ipv4Address, std::list<CacheEntry> > cache;
+  std::map<Ipv4Address, dst_cache_t> cache;
+  
+  uint32_t total_packets;
+  uint64_t total_bytes;
+  
+  // Min heap of the expiry times of all cached packets
+  std::vector<cache_expiry_t> expiry;
+  Timer expiry_timer;
+  
+  Callback<void, CacheEntry, std::string> drop_cb;
   
 };
 
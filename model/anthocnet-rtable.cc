@@ -30,17 +30,119 @@ namespace ahn {
 RoutingTableEntry::RoutingTableEntry() {
     this->pheromone = 0;
     this->virtual_pheromone = 0;
-    
+    this->nb_pos = NO_POSITION;
+    this->last_update = Seconds(0);
 }
 
 RoutingTableEntry::~RoutingTableEntry() {}
 
+void RoutingTableEntry::Clear() {
+  this->pheromone = 0;
+  this->virtual_pheromone = 0;
+}
+
+
+// ------------------------------------------------------
+AliasTable::AliasTable() {}
+
+AliasTable::~AliasTable() {}
+
+void AliasTable::Build(const ProbVect& pv) {
+  
+  this->Clear();
+  
+  double total = 0;
+  for (auto pv_it = pv.begin(); pv_it != pv.end(); ++pv_it) {
+    total += pv_it->second;
+  }
+  
+  if (pv.empty() || !(total > 0))
+    return;
+  
+  uint32_t n = pv.size();
+  
+  // Scale the probabilities such that their mean is one
+  for (uint32_t i = 0; i < n; i++) {
+    this->hops.push_back(pv[i].first);
+    this->prob.push_back(pv[i].second * n / total);
+    this->alias.push_back(i);
+    
+    if (this->prob[i] < 1.0)
+      this->small.push_back(i);
+    else
+      this->large.push_back(i);
+  }
+  
+  // Fill every underfull column with the excess of a full one
+  while (!this->small.empty() && !this->large.empty()) {
+    uint32_t l = this->small.back();
+    this->small.pop_back();
+    uint32_t g = this->large.back();
+    this->large.pop_back();
+    
+    this->alias[l] = g;
+    this->prob[g] = (this->prob[g] + this->prob[l]) - 1.0;
+    
+    if (this->prob[g] < 1.0)
+      this->small.push_back(g);
+    else
+      this->large.push_back(g);
+  }
+  
+  // Whatever is left over is full up to rounding errors
+  for (auto it = this->small.begin(); it != this->small.end(); ++it)
+    this->prob[*it] = 1.0;
+  for (auto it = this->large.begin(); it != this->large.end(); ++it)
+    this->prob[*it] = 1.0;
+  
+  this->small.clear();
+  this->large.clear();
+}
+
+void AliasTable::Clear() {
+  this->prob.clear();
+  this->alias.clear();
+  this->hops.clear();
+}
+
+bool AliasTable::IsEmpty() const {
+  return this->hops.empty();
+}
+
+Ipv4Address AliasTable::Sample(double select) const {
+  
+  NS_ASSERT(!this->IsEmpty());
+  
+  // The integer part selects the column, the fractional
+  // part decides between the column and its alias
+  double x = select * this->hops.size();
+  uint32_t i = std::floor(x);
+  if (i >= this->hops.size())
+    i = this->hops.size() - 1;
+  
+  if (x - i < this->prob[i])
+    return this->hops[i];
+  else
+    return this->hops[this->alias[i]];
+}
+
+// ------------------------------------------------------
+NextHopCache::NextHopCache() :
+  valid(false),
+  beta(0),
+  trust_epoch(0),
+  valid_until(Seconds(0))
+  {}
+
+NextHopCache::~NextHopCache() {
+}
 
 // ------------------------------------------------------
 DestinationInfo::DestinationInfo() :
   no_broadcast_time(Seconds(0)),
   session_time(Seconds(0)),
-  session_active(false)
+  session_active(false),
+  index(0)
   {}
 
 DestinationInfo::~DestinationInfo() {
@@ -49,20 +151,185 @@ DestinationInfo::~DestinationInfo() {
 // ---------------F-----------------------------------------
 NeighborInfo::NeighborInfo() :
   avr_T_send(Seconds(0)),
-  last_snr(0)
+  last_snr(0),
+  trust(-1),
+  trust_time(Seconds(0)),
+  trust_version(0),
+  trust_dirty(false),
+  last_seen(Seconds(0)),
+  generation(0),
+  in_wheel(false),
+  index(0)
   {}
 
 NeighborInfo::~NeighborInfo() {
 }
 
+// ---------------------------------------------------------
+BestPheromone::BestPheromone() {
+  this->Reset();
+}
+
+BestPheromone::~BestPheromone() {
+}
+
+void BestPheromone::Reset() {
+  this->first = NO_COLUMN;
+  this->first_value = -std::numeric_limits<double>::infinity();
+  this->second = NO_COLUMN;
+  this->second_value = -std::numeric_limits<double>::infinity();
+  this->dirty = false;
+}
+
+void BestPheromone::Update(uint32_t col, double value) {
+  
+  // Will be rebuilt anyway
+  if (this->dirty)
+    return;
+  
+  if (col == this->first) {
+    if (value >= this->second_value)
+      this->first_value = value;
+    else
+      this->dirty = true;
+  }
+  else if (col == this->second) {
+    if (value > this->first_value) {
+      this->second = this->first;
+      this->second_value = this->first_value;
+      this->first = col;
+      this->first_value = value;
+    }
+    else if (value >= this->second_value) {
+      this->second_value = value;
+    }
+    else {
+      // The third best value is unknown
+      this->dirty = true;
+    }
+  }
+  else if (value > this->first_value) {
+    this->second = this->first;
+    this->second_value = this->first_value;
+    this->first = col;
+    this->first_value = value;
+  }
+  else if (value > this->second_value) {
+    this->second = col;
+    this->second_value = value;
+  }
+}
+
+// ---------------------------------------------------------
+AntHistWindow::AntHistWindow() :
+  last_seen(Seconds(0)),
+  highest(0),
+  empty(true)
+  {}
+
+AntHistWindow::~AntHistWindow() {
+}
+
+void AntHistWindow::Init(uint32_t window_size) {
+  
+  // Round up to full words, at least one
+  uint32_t words = (window_size + 63) / 64;
+  if (words == 0)
+    words = 1;
+  
+  this->bits.assign(words, 0);
+  this->highest = 0;
+  this->empty = true;
+}
+
+bool AntHistWindow::Has(uint64_t seqno) const {
+  
+  if (this->empty || seqno > this->highest)
+    return false;
+  
+  uint64_t size = this->bits.size() * 64;
+  if (this->highest - seqno >= size)
+    return true;
+  
+  uint64_t pos = seqno % size;
+  return (this->bits[pos / 64] >> (pos % 64)) & 1;
+}
+
+void AntHistWindow::Add(uint64_t seqno) {
+  
+  uint64_t size = this->bits.size() * 64;
+  
+  if (this->empty) {
+    this->highest = seqno;
+    this->empty = false;
+  }
+  else if (seqno > this->highest) {
+    
+    // Clear the slots, the window slides over
+    if (seqno - this->highest >= size) {
+      std::fill(this->bits.begin(), this->bits.end(), 0);
+    }
+    else {
+      for (uint64_t s = this->highest + 1; s <= seqno; s++) {
+        uint64_t pos = s % size;
+        this->bits[pos / 64] &= ~(uint64_t(1) << (pos % 64));
+      }
+    }
+    this->highest = seqno;
+  }
+  else if (this->highest - seqno >= size) {
+    // Too old, already considered seen
+    return;
+  }
+  
+  uint64_t pos = seqno % size;
+  this->bits[pos / 64] |= (uint64_t(1) << (pos % 64));
+}
+
+// ---------------------------------------------------------
+HousekeepingStats::HousekeepingStats() :
+  passes(0),
+  dsts_visited(0),
+  sessions_expired(0),
+  entries_cleared(0),
+  dsts_removed(0),
+  history_purged(0)
+  {}
+
+HousekeepingStats::~HousekeepingStats() {
+}
+
+void HousekeepingStats::Print(std::ostream& os) const {
+  os << "Housekeeping passes: " << this->passes
+  << " visited: " << this->dsts_visited
+  << " sessions expired: " << this->sessions_expired
+  << " entries cleared: " << this->entries_cleared
+  << " dsts removed: " << this->dsts_removed
+  << " history purged: " << this->history_purged
+  << std::endl;
+}
+
+// ---------------------------------------------------------
 RoutingTable::RoutingTable() :
-seqno(0)
+nb_stride(8),
+nb_wheel_timer(Timer::CANCEL_ON_DESTROY),
+nb_wheel_tick(0),
+nb_wheel_next(0),
+nb_wheel_count(0),
+nb_generation(0),
+seqno(0),
+trust_epoch(0)
 {}
   
 RoutingTable::~RoutingTable() {}
 
 void RoutingTable::SetConfig(Ptr<AntHocNetConfig> config) {
   this->config = config;
+  if (config != 0) {
+    this->stat.SetSampling(config->watchdog_sampling, 
+      config->watchdog_adaptive, config->watchdog_adaptive_threshold);
+    this->stat.SetChangeCallback(MakeCallback(&RoutingTable::StatChanged, this));
+  }
 }
 
 Ptr<AntHocNetConfig> RoutingTable::GetConfig() const {
@@ -72,11 +339,28 @@ Ptr<AntHocNetConfig> RoutingTable::GetConfig() const {
 
 void RoutingTable::AddNeighbor(Ipv4Address nb) {
   if (!this->IsNeighbor(nb)) {
-    this->nbs.insert(std::make_pair(nb, NeighborInfo()));
-    this->AddDestination(nb);
     
-    // Add timer
-    this->nb_timers.insert(std::make_pair(nb, Timer(Timer::CANCEL_ON_DESTROY)));
+    NeighborInfo nb_info;
+    
+    // Reuse a free column or append a new one
+    if (!this->free_nb_index.empty()) {
+      nb_info.index = this->free_nb_index.back();
+      this->free_nb_index.pop_back();
+      this->nb_index[nb_info.index] = nb;
+    }
+    else {
+      if (this->nb_index.size() == this->nb_stride)
+        this->GrowNeighborColumns();
+      
+      nb_info.index = this->nb_index.size();
+      this->nb_index.push_back(nb);
+      this->nb_dsts.push_back(std::vector<uint32_t>());
+    }
+    
+    nb_info.generation = ++this->nb_generation;
+    
+    this->nbs.insert(std::make_pair(nb, nb_info));
+    this->AddDestination(nb);
     
   }
 }
@@ -90,21 +374,49 @@ bool RoutingTable::IsNeighbor(NbIt nb_it) {
 }
 
 void RoutingTable::RemoveNeighbor(Ipv4Address nb) {
-  for (auto dst_it = this->dsts.begin(); dst_it != this->dsts.end(); ++dst_it) {
-    this->RemovePheromone(dst_it->first, nb);
+  
+  auto nb_it = this->nbs.find(nb);
+  if (!this->IsNeighbor(nb_it))
+    return;
+  
+  // Clear the entries of this neighbor
+  uint32_t col = nb_it->second.index;
+  std::vector<uint32_t> rows;
+  rows.swap(this->nb_dsts[col]);
+  
+  for (uint32_t i = 0; i < rows.size(); i++) {
+    this->GetRow(rows[i])[col] = RoutingTableEntry();
+    
+    auto dst_it = this->dsts.find(this->dst_index[rows[i]]);
+    this->EntryChanged(dst_it->second, col);
   }
   
-  // Remove timeout event
-  auto nbt_it = this->nb_timers.find(nb);
-  if (nbt_it != this->nb_timers.end())
-    nbt_it->second.Remove();
+  // A pending wheel entry is skipped by its generation
+  if (nb_it->second.in_wheel)
+    this->nb_wheel_count--;
   
-  this->nbs.erase(nb);
+  this->free_nb_index.push_back(col);
+  this->nbs.erase(nb_it);
 }
 
 void RoutingTable::AddDestination(Ipv4Address dst) {
-    if (!this->IsDestination(dst)) {
-    this->dsts.insert(std::make_pair(dst, DestinationInfo()));
+  if (!this->IsDestination(dst)) {
+    
+    DestinationInfo dst_info;
+    
+    // Reuse a free row or append a new one
+    if (!this->free_dst_index.empty()) {
+      dst_info.index = this->free_dst_index.back();
+      this->free_dst_index.pop_back();
+      this->dst_index[dst_info.index] = dst;
+    }
+    else {
+      dst_info.index = this->dst_index.size();
+      this->dst_index.push_back(dst);
+      this->rtable.resize(this->dst_index.size() * this->nb_stride);
+    }
+    
+    this->dsts.insert(std::make_pair(dst, dst_info));
   }
 }
 
@@ -118,55 +430,62 @@ bool RoutingTable::IsDestination(DstIt dst_it) {
 
 void RoutingTable::RemoveDestination(Ipv4Address dst) {
   
-  for (auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
-    this->RemovePheromone(dst, nb_it->first);
-  }
+  auto dst_it = this->dsts.find(dst);
+  if (!this->IsDestination(dst_it))
+    return;
+  
   this->RemoveNeighbor(dst);
-  this->dsts.erase(dst);
+  
+  // Clear the row of this destination
+  RoutingTableEntry* row = this->GetRow(dst_it->second.index);
+  for (uint32_t i = 0; i < this->nb_stride; i++) {
+    if (row[i].nb_pos != NO_POSITION)
+      this->UnlinkEntry(dst_it->second.index, i);
+    row[i] = RoutingTableEntry();
+  }
+  
+  this->free_dst_index.push_back(dst_it->second.index);
+  this->dsts.erase(dst_it);
 }
 
 void RoutingTable::AddPheromone(Ipv4Address dst, Ipv4Address nb, 
                                 double pher, double virt_pher) {
   
-  std::make_pair(dst, nb) == std::make_pair(nb, dst);
-  
-  auto key = std::make_pair(dst, nb);
-  auto p_it = this->rtable.find(key);
+  auto dst_it = this->dsts.find(dst);
+  auto nb_it = this->nbs.find(nb);
+  if (!this->IsDestination(dst_it) || !this->IsNeighbor(nb_it))
+    return;
   
-  if (p_it == this->rtable.end()) {
-    if (!this->IsDestination(dst) || !this->IsNeighbor(nb))
-      return;
-    
-    this->rtable.insert(std::make_pair(key, RoutingTableEntry()));
-    p_it = this->rtable.find(key);
-  }
+  RoutingTableEntry* entry = 
+    &this->GetRow(dst_it->second.index)[nb_it->second.index];
   
-  p_it->second.pheromone = pher;
-  p_it->second.virtual_pheromone = virt_pher;
+  entry->pheromone = pher;
+  entry->virtual_pheromone = virt_pher;
+  entry->last_update = Simulator::Now();
   
+  this->EntryChanged(dst_it->second, nb_it->second.index);
 }
 
 void RoutingTable::RemovePheromone(Ipv4Address dst, Ipv4Address nb) {
-  this->rtable.erase(std::make_pair(dst, nb));
+  
+  auto dst_it = this->dsts.find(dst);
+  auto nb_it = this->nbs.find(nb);
+  if (!this->IsDestination(dst_it) || !this->IsNeighbor(nb_it))
+    return;
+  
+  this->GetRow(dst_it->second.index)[nb_it->second.index].Clear();
+  this->EntryChanged(dst_it->second, nb_it->second.index);
 }
 
 bool RoutingTable::HasPheromone(Ipv4Address dst, Ipv4Address nb, bool virt) {
-  auto p_it = this->rtable.find(std::make_pair(dst, nb));
-  if (p_it == this->rtable.end())
+  RoutingTableEntry* entry = this->FindEntry(dst, nb);
+  if (entry == 0)
     return false;
   
-  if (!virt) {
-    if (p_it->second.pheromone > this->config->min_pheromone)
-      return true;
-    else
-      return false;
-  } else {
-    if (p_it->second.virtual_pheromone > this->config->min_pheromone)
-      return true;
-    else
-      return false;
-  }
-  
+  if (this->ReadPheromone(*entry, virt) > this->config->min_pheromone)
+    return true;
+  else
+    return false;
 }
 
 void RoutingTable::SetPheromone(Ipv4Address dst, Ipv4Address nb,
@@ -174,38 +493,38 @@ void RoutingTable::SetPheromone(Ipv4Address dst, Ipv4Address nb,
   
   //NS_ASSERT(pher <= 1);
   
-  auto p_it = this->rtable.find(std::make_pair(dst, nb));
+  auto dst_it = this->dsts.find(dst);
+  auto nb_it = this->nbs.find(nb);
+  if (!this->IsDestination(dst_it) || !this->IsNeighbor(nb_it))
+    return;
   
-  if (p_it == this->rtable.end()) {
-    this->AddPheromone(dst, nb, 0, 0);
-    p_it = this->rtable.find(std::make_pair(dst, nb));
-  }
+  RoutingTableEntry* entry = 
+    &this->GetRow(dst_it->second.index)[nb_it->second.index];
+  
+  // Bring the other value up to date, since they share the timestamp
+  this->MaterializeEntry(*entry);
   
   if (!virt)
-    p_it->second.pheromone = pher;
+    entry->pheromone = pher;
   else
-    p_it->second.virtual_pheromone = pher;
+    entry->virtual_pheromone = pher;
   
-  if (p_it->second.pheromone < this->config->min_pheromone 
-    && p_it->second.virtual_pheromone < this->config->min_pheromone) {
-    this->rtable.erase(p_it);
+  if (entry->pheromone < this->config->min_pheromone 
+    && entry->virtual_pheromone < this->config->min_pheromone) {
+    entry->Clear();
   }
   
+  this->EntryChanged(dst_it->second, nb_it->second.index);
 }
 
 double RoutingTable::GetPheromone(Ipv4Address dst, Ipv4Address nb, bool virt) {
   
-  auto p_it = this->rtable.find(std::make_pair(dst, nb));
+  RoutingTableEntry* entry = this->FindEntry(dst, nb);
   
-  if (p_it == this->rtable.end())
+  if (entry == 0 || this->IsEmpty(*entry))
     return 0;
   
-  NS_ASSERT(p_it->second.pheromone > this->config->min_pheromone || p_it->second.virtual_pheromone > this->config->min_pheromone);
-  
-  if (!virt)
-    return p_it->second.pheromone;
-  else
-    return p_it->second.virtual_pheromone;
+  return this->ReadPheromone(*entry, virt);
 }
 
 
@@ -228,26 +547,24 @@ void RoutingTable::UpdatePheromone(Ipv4Address dst, Ipv4Address nb,
   }
   
   
-  for (auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
-    
-    double old_phero = this->GetPheromone(dst, nb_it->first, virt);
-    // This is the neigbor we are processing our data for
-    if (nb_it == target_nb_it) {
-      double new_phero;
-      
-      // Why does this make results worese
-      //if (old_phero == 0)
-      //  new_phero = update;
-      //else
-      new_phero = this->IncressPheromone(old_phero, update);
-      
-      this->SetPheromone(dst, nb_it->first, new_phero, virt);
-    } else {
-      // Evaporate the value
-      //double new_phero = this->EvaporatePheromone(old_phero);
-      //this->SetPheromone(dst, nb_it->first, new_phero, virt);
-    } 
-  }
+  // The other neighbors need no update, their pheromone
+  // evaporates when it is read
+  RoutingTableEntry& entry = 
+    this->GetRow(dst_it->second.index)[target_nb_it->second.index];
+  
+  double old_phero = 0;
+  if (!this->IsEmpty(entry))
+    old_phero = this->ReadPheromone(entry, virt);
+  
+  double new_phero;
+  
+  // Why does this make results worese
+  //if (old_phero == 0)
+  //  new_phero = update;
+  //else
+  new_phero = this->IncressPheromone(old_phero, update);
+  
+  this->SetPheromone(dst, nb, new_phero, virt);
 }
 
 void RoutingTable::RegisterSession(Ipv4Address dst) {
@@ -383,13 +700,111 @@ void RoutingTable::UpdateNeighbor(Ipv4Address nb) {
   if (!this->IsNeighbor(nb_it))
     return;
   
-  auto nbt_it = this->nb_timers.find(nb);
-  if(nbt_it == this->nb_timers.end())
+  nb_it->second.last_seen = Simulator::Now();
+  
+  if (nb_it->second.in_wheel)
     return;
   
-  nbt_it->second.Remove();
-  nbt_it->second.Schedule(this->config->nb_expire);
+  int64_t tick = this->InsertNeighborWheel(nb, nb_it->second);
+  if (!this->nb_wheel_timer.IsRunning() || tick < this->nb_wheel_next)
+    this->ScheduleNeighborWheel();
+}
+
+void RoutingTable::SetNeighborExpireCallback(Callback<void, Ipv4Address> cb) {
+  this->nb_expire_cb = cb;
+}
+
+int64_t RoutingTable::InsertNeighborWheel(Ipv4Address nb, NeighborInfo& nb_info) {
+  
+  int64_t granularity = this->config->nb_expire_granularity.GetNanoSeconds();
+  
+  // Enough slots to cover nb_expire, set up on first use
+  if (this->nb_wheel.empty()) {
+    uint32_t num_slots = 
+      this->config->nb_expire.GetNanoSeconds() / granularity + 2;
+    this->nb_wheel.resize(num_slots);
+    this->nb_wheel_timer.SetFunction(&RoutingTable::NeighborWheelExpire, this);
+  }
+  
+  // An empty wheel restarts from the current time
+  if (this->nb_wheel_count == 0) {
+    this->nb_wheel_tick = Simulator::Now().GetNanoSeconds() / granularity;
+  }
   
+  // The slot at or after the deadline
+  int64_t deadline = (nb_info.last_seen + this->config->nb_expire).GetNanoSeconds();
+  int64_t tick = (deadline + granularity - 1) / granularity;
+  if (tick <= this->nb_wheel_tick)
+    tick = this->nb_wheel_tick + 1;
+  
+  this->nb_wheel[tick % this->nb_wheel.size()].push_back(
+    std::make_pair(nb, nb_info.generation));
+  nb_info.in_wheel = true;
+  this->nb_wheel_count++;
+  
+  return tick;
+}
+
+void RoutingTable::ScheduleNeighborWheel() {
+  
+  this->nb_wheel_timer.Cancel();
+  if (this->nb_wheel_count == 0)
+    return;
+  
+  // Skip the empty slots
+  uint32_t num_slots = this->nb_wheel.size();
+  int64_t tick = this->nb_wheel_tick + 1;
+  for (uint32_t i = 0; i < num_slots; i++, tick++) {
+    if (!this->nb_wheel[tick % num_slots].empty())
+      break;
+  }
+  
+  int64_t granularity = this->config->nb_expire_granularity.GetNanoSeconds();
+  Time delay = NanoSeconds(tick * granularity) - Simulator::Now();
+  if (delay < Seconds(0))
+    delay = Seconds(0);
+  
+  this->nb_wheel_next = tick;
+  this->nb_wheel_timer.Schedule(delay);
+}
+
+void RoutingTable::NeighborWheelExpire() {
+  
+  this->nb_wheel_tick = this->nb_wheel_next;
+  
+  NbWheelSlot slot;
+  slot.swap(this->nb_wheel[this->nb_wheel_tick % this->nb_wheel.size()]);
+  
+  Time now = Simulator::Now();
+  std::vector<Ipv4Address> expired;
+  
+  for (uint32_t i = 0; i < slot.size(); i++) {
+    
+    // Skip neighbors, which have been removed since
+    auto nb_it = this->nbs.find(slot[i].first);
+    if (!this->IsNeighbor(nb_it) || nb_it->second.generation != slot[i].second)
+      continue;
+    
+    this->nb_wheel_count--;
+    nb_it->second.in_wheel = false;
+    
+    // Seen in the meantime, move on to the new deadline
+    if (nb_it->second.last_seen + this->config->nb_expire > now) {
+      this->InsertNeighborWheel(nb_it->first, nb_it->second);
+      continue;
+    }
+    
+    expired.push_back(nb_it->first);
+  }
+  
+  this->ScheduleNeighborWheel();
+  
+  // The callback removes the neighbors from the table
+  for (uint32_t i = 0; i < expired.size(); i++) {
+    NS_LOG_FUNCTION(this << "nb" << expired[i] << "expired");
+    if (!this->nb_expire_cb.IsNull())
+      this->nb_expire_cb(expired[i]);
+  }
 }
 
 bool RoutingTable::SelectRoute(Ipv4Address dst, double beta,
@@ -418,27 +833,22 @@ bool RoutingTable::SelectRouteStandard(Ipv4Address dst, double beta,
     return false;
   }
   
+  // The distribution only changes with the pheromone, 
+  // so it is only recalculated if it has been invalidated
+  NextHopCache& cache = dst_it->second.route_cache[virt ? 1 : 0];
+  if (!cache.valid || cache.beta != beta 
+      || Simulator::Now() >= cache.valid_until) {
+    this->BuildRouteCache(cache, dst, beta, virt);
+  }
+  
   // Fail, if there are no initialized entries (same as no entires at all)
-  ProbVect pv;
-  if (this->GetProbVector(pv, dst, beta, virt) == 0) {
+  if (cache.table.IsEmpty()) {
     NS_LOG_FUNCTION(this << "no initialized nbs");
     return false;
   }
   
-  double select = vr->GetValue(0.0, 1.0);
-  double selected = 0.0;
-  
-  for (auto pv_it = pv.begin(); pv_it != pv.end(); pv_it++) {
-    selected += pv_it->second;
-    if (selected > select) {
-      nb = pv_it->first;
-      return true;
-    } 
-  }
-  
-  // Never come here
-  NS_LOG_FUNCTION(this << "never come here");
-  return false;
+  nb = cache.table.Sample(vr->GetValue(0.0, 1.0));
+  return true;
 }
 
 
@@ -469,24 +879,31 @@ bool RoutingTable::SelectRandomRoute(Ipv4Address& nb,
 void RoutingTable::ProcessNeighborTimeout(LinkFailureHeader& msg, 
                                           Ipv4Address nb) {
   
-  for (auto dst_it = this->dsts.begin(); dst_it != this->dsts.end(); ++dst_it) {
+  auto nb_it = this->nbs.find(nb);
+  if (!this->IsNeighbor(nb_it))
+    return;
+  
+  uint32_t col = nb_it->second.index;
+  const std::vector<uint32_t>& rows = this->nb_dsts[col];
+  
+  for (uint32_t i = 0; i < rows.size(); i++) {
     
-    auto p_it = this->rtable.find(std::make_pair(dst_it->first, nb));
-    if (p_it == this->rtable.end() 
-          || p_it->second.pheromone < this->config->min_pheromone) {
+    Ipv4Address dst = this->dst_index[rows[i]];
+    double phero = this->ReadPheromone(this->GetRow(rows[i])[col], false);
+    if (phero < this->config->min_pheromone) {
       continue;
     }
     
-    auto other_inits = this->IsOnly(dst_it->first, nb);
+    auto other_inits = this->IsOnly(dst, nb);
     
     if (!other_inits.first) {
-      msg.AppendUpdate(dst_it->first, ONLY_VALUE, 0.0);
+      msg.AppendUpdate(dst, ONLY_VALUE, 0.0);
     }
-    else if (other_inits.second < p_it->second.pheromone) {
-      msg.AppendUpdate(dst_it->first, NEW_BEST_VALUE, other_inits.second);
+    else if (other_inits.second < phero) {
+      msg.AppendUpdate(dst, NEW_BEST_VALUE, other_inits.second);
     }
     else {
-     msg.AppendUpdate(dst_it->first, VALUE, 0.0); 
+     msg.AppendUpdate(dst, VALUE, 0.0); 
     }
   }
   NS_LOG_FUNCTION(this << "NB Timeout: " << msg);
@@ -600,59 +1017,55 @@ void RoutingTable::ConstructHelloMsg(HelloMsgHeader& msg, uint32_t num_dsts,
     use_random = false;
   }
   
-  std::list<std::pair<Ipv4Address, double> > selection;
+  // Candidates are collected in a buffer, which is reused across calls
+  std::vector<std::pair<Ipv4Address, double> >& selection = 
+    this->hello_selection;
+  selection.clear();
   
   for (auto dst_it = this->dsts.begin(); dst_it != this->dsts.end(); ++dst_it) {
     
     Ipv4Address temp_dst = dst_it->first;
-    double best_phero = 0.0;
     
-    for (auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
-      
-      auto p_it = this->rtable.find(std::make_pair(dst_it->first, nb_it->first));
-      if (p_it == this->rtable.end())
-        continue;
-      
-      if (std::abs(best_phero) < p_it->second.pheromone)
-        best_phero = p_it->second.pheromone;
-      
-      
-      if (std::abs(best_phero) < p_it->second.virtual_pheromone)
-        best_phero = -1.0 * p_it->second.virtual_pheromone;
-    }
-   
-   // Exclude neighbors from hello message
-   if (this->IsNeighbor(temp_dst))
-     continue;
-   
-   if (best_phero > this->config->min_pheromone)
-     selection.push_back(std::make_pair(temp_dst, best_phero));
+    // Exclude neighbors from hello message
+    if (this->IsNeighbor(temp_dst))
+      continue;
+    
+    // Virtual pheromone is sent negative
+    RoutingTableEntry* row = this->GetRow(dst_it->second.index);
+    uint32_t real_col = this->GetBest(dst_it->second, false).first;
+    uint32_t virt_col = this->GetBest(dst_it->second, true).first;
+    
+    double best_real = 0;
+    if (real_col != NO_COLUMN)
+      best_real = this->ReadPheromone(row[real_col], false);
+    double best_virt = 0;
+    if (virt_col != NO_COLUMN)
+      best_virt = this->ReadPheromone(row[virt_col], true);
+    
+    double best_phero = best_real;
+    if (best_real < best_virt)
+      best_phero = -1.0 * best_virt;
+    
+    if (best_phero > this->config->min_pheromone)
+      selection.push_back(std::make_pair(temp_dst, best_phero));
   }
   
-  // Now select some of the pairs we found
-  for (uint32_t i = 0; i < num_dsts; i++) {
+  // Now select some of the pairs we found.
+  // Partial Fisher-Yates, the first i entries are already selected
+  uint32_t num_select = std::min<uint32_t>(num_dsts, selection.size());
+  for (uint32_t i = 0; i < num_select; i++) {
     
-    if (selection.empty()) 
-      break;
-    
-    uint32_t select;
+    uint32_t select = i;
     if (use_random) {
-      select = std::floor(vr->GetValue(0.0, selection.size()));
-    }
-    else {
-      select = 0;
+      select += std::floor(vr->GetValue(0.0, selection.size() - i));
+      if (select >= selection.size())
+        select = selection.size() - 1;
     }
     
     //NS_LOG_FUNCTION(this << "select" << select << "ndst" << selection.size());
     
-    // Get to the selection
-    auto sel_it = selection.begin();
-    for (uint32_t c = select; c > 0; c--) {
-      sel_it++;
-    }
-    
-    msg.PushDiffusion(sel_it->first, sel_it->second);
-    selection.erase(sel_it); 
+    std::swap(selection[i], selection[select]);
+    msg.PushDiffusion(selection[i].first, selection[i].second);
   }
   
   //NS_LOG_FUNCTION(this << "message" << msg);
@@ -747,12 +1160,134 @@ uint64_t RoutingTable::NextSeqno() {
 }
 
 bool RoutingTable::HasHistory(Ipv4Address dst, uint64_t seqno) {
-  auto hist_it = this->history.find(std::make_pair(dst, seqno));
-  return (hist_it != this->history.end());
+  auto hist_it = this->history.find(dst);
+  if (hist_it == this->history.end())
+    return false;
+  
+  // An expired window is as good as no window
+  if (hist_it->second.last_seen + this->config->history_expire 
+    < Simulator::Now())
+    return false;
+  
+  return hist_it->second.Has(seqno);
 }
 
 void RoutingTable::AddHistory(Ipv4Address dst, uint64_t seqno) {
-  this->history.insert(std::make_pair(dst, seqno));
+  
+  auto hist_it = this->history.find(dst);
+  if (hist_it == this->history.end()) {
+    
+    // Make room for the new source
+    if (this->history.size() >= this->config->history_max_sources) {
+      this->PurgeHistory();
+    }
+    if (this->history.size() >= this->config->history_max_sources) {
+      
+      // Still full, drop the least recently seen source
+      auto oldest = this->history.begin();
+      for (auto it = this->history.begin(); it != this->history.end(); ++it) {
+        if (it->second.last_seen < oldest->second.last_seen)
+          oldest = it;
+      }
+      NS_LOG_FUNCTION(this << "history full, drop" << oldest->first);
+      this->history.erase(oldest);
+    }
+    
+    hist_it = this->history.insert(
+      std::make_pair(dst, AntHistWindow())).first;
+    hist_it->second.Init(this->config->history_window);
+  }
+  else if (hist_it->second.last_seen + this->config->history_expire 
+    < Simulator::Now()) {
+    hist_it->second.Init(this->config->history_window);
+  }
+  
+  hist_it->second.Add(seqno);
+  hist_it->second.last_seen = Simulator::Now();
+}
+
+uint32_t RoutingTable::PurgeHistory() {
+  
+  uint32_t purged = 0;
+  Time now = Simulator::Now();
+  for (auto it = this->history.begin(); it != this->history.end(); /**/) {
+    if (it->second.last_seen + this->config->history_expire < now) {
+      this->history.erase(it++);
+      purged++;
+    }
+    else {
+      ++it;
+    }
+  }
+  return purged;
+}
+
+void RoutingTable::Housekeeping(uint32_t max_dsts) {
+  
+  Time now = Simulator::Now();
+  if (this->dsts.empty()) {
+    this->housekeeping_stats.history_purged += this->PurgeHistory();
+    return;
+  }
+  
+  uint32_t num_visit = std::min<uint32_t>(max_dsts, this->dsts.size());
+  
+  auto dst_it = this->dsts.upper_bound(this->housekeeping_cursor);
+  
+  for (uint32_t visited = 0; visited < num_visit; visited++) {
+    
+    // Wrap around, a cycle over all destinations is complete
+    if (dst_it == this->dsts.end()) {
+      this->housekeeping_stats.passes++;
+      this->housekeeping_stats.history_purged += this->PurgeHistory();
+      dst_it = this->dsts.begin();
+    }
+    
+    Ipv4Address dst = dst_it->first;
+    DestinationInfo& dst_info = dst_it->second;
+    this->housekeeping_cursor = dst;
+    this->housekeeping_stats.dsts_visited++;
+    
+    // Expire the session
+    if (dst_info.session_active 
+      && now - dst_info.session_time >= this->config->session_expire) {
+      dst_info.session_active = false;
+      this->housekeeping_stats.sessions_expired++;
+    }
+    
+    // Clear entries, which have decayed below the threshold
+    bool has_entries = false;
+    RoutingTableEntry* row = this->GetRow(dst_info.index);
+    for (uint32_t i = 0; i < this->nb_index.size(); i++) {
+      if (this->IsEmpty(row[i]))
+        continue;
+      
+      if (this->ReadPheromone(row[i], false) < this->config->min_pheromone
+        && this->ReadPheromone(row[i], true) < this->config->min_pheromone) {
+        row[i].Clear();
+        this->EntryChanged(dst_info, i);
+        this->housekeeping_stats.entries_cleared++;
+        continue;
+      }
+      has_entries = true;
+    }
+    
+    ++dst_it;
+    
+    // A destination without any use is dropped
+    if (!has_entries && !dst_info.session_active 
+      && now > dst_info.no_broadcast_time
+      && !this->IsNeighbor(dst)) {
+      
+      NS_LOG_FUNCTION(this << "housekeeping removes" << dst);
+      this->RemoveDestination(dst);
+      this->housekeeping_stats.dsts_removed++;
+    }
+  }
+}
+
+const HousekeepingStats& RoutingTable::GetHousekeepingStats() const {
+  return this->housekeeping_stats;
 }
 
 // Private methods
@@ -767,24 +1302,27 @@ std::pair<bool, double> RoutingTable::IsOnly(Ipv4Address dst,
   
   bool other_inits = false;
   double best_phero = 0;
+  
+  auto dst_it = this->dsts.find(dst);
+  if (!this->IsDestination(dst_it))
+    return std::make_pair(other_inits, best_phero);
+  
+  uint32_t marked = NO_COLUMN;
   auto marked_nb_it = this->nbs.find(nb);
+  if (this->IsNeighbor(marked_nb_it))
+    marked = marked_nb_it->second.index;
   
-  for(auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
-    
-    if (nb_it == marked_nb_it)
-      continue;
-    
-    auto p_it = this->rtable.find(std::make_pair(dst, nb_it->first));
-    if (p_it == this->rtable.end())
-      continue;
-    
-    if (p_it->second.pheromone > this->config->min_pheromone) {
-      other_inits = true;
-      
-      if(p_it->second.pheromone > best_phero) {
-        best_phero = p_it->second.pheromone;
-      }
-    }
+  // The best value not going over the marked neighbor
+  const BestPheromone& best = this->GetBest(dst_it->second, false);
+  uint32_t col = (best.first == marked) ? best.second : best.first;
+  
+  double value = 0;
+  if (col != NO_COLUMN)
+    value = this->ReadPheromone(this->GetRow(dst_it->second.index)[col], false);
+  
+  if (value > this->config->min_pheromone) {
+    other_inits = true;
+    best_phero = value;
   }
   
   NS_ASSERT((other_inits && best_phero != 0) || (!other_inits));
@@ -795,20 +1333,28 @@ std::pair<bool, double> RoutingTable::IsOnly(Ipv4Address dst,
 double RoutingTable::SumPropability(Ipv4Address dst, double beta, bool virt) {
   
   double Sum = 0;
-  for (auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
-    auto p_it = this->rtable.find(std::make_pair(dst, nb_it->first));
+  
+  auto dst_it = this->dsts.find(dst);
+  if (!this->IsDestination(dst_it))
+    return Sum;
+  
+  RoutingTableEntry* row = this->GetRow(dst_it->second.index);
+  for (uint32_t i = 0; i < this->nb_index.size(); i++) {
     
-    if (p_it == this->rtable.end())
+    if (this->IsEmpty(row[i]))
       continue;
     
+    double phero = this->ReadPheromone(row[i], false);
+    double virt_phero = this->ReadPheromone(row[i], true);
+    
     if (virt) {
-      if (p_it->second.virtual_pheromone > p_it->second.pheromone)
-        Sum += pow(p_it->second.virtual_pheromone, beta);
+      if (virt_phero > phero)
+        Sum += pow(virt_phero, beta);
       else
-        Sum += pow(p_it->second.pheromone, beta);
+        Sum += pow(phero, beta);
     }
     else {
-      Sum += pow(p_it->second.pheromone, beta);
+      Sum += pow(phero, beta);
     } 
   }
   return Sum;
@@ -829,33 +1375,221 @@ uint32_t RoutingTable::GetProbVector(ProbVect& pv, Ipv4Address dst,
   
   NS_LOG_FUNCTION("Total phero" << total_pheromone);
   
-  for (auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
+  // SumPropability made sure, the destination exists
+  RoutingTableEntry* row = this->GetRow(this->dsts.find(dst)->second.index);
+  
+  for (uint32_t i = 0; i < this->nb_index.size(); i++) {
     
-    auto p_it = this->rtable.find(std::make_pair(dst, nb_it->first));
-    if (p_it == this->rtable.end())
+    if (this->IsEmpty(row[i]))
       continue;
     
-    if (virt && p_it->second.virtual_pheromone > p_it->second.pheromone) {
-      if (p_it->second.virtual_pheromone > this->config->min_pheromone)
-        cur_pheromone = pow(p_it->second.virtual_pheromone, beta)/ total_pheromone;
+    double phero = this->ReadPheromone(row[i], false);
+    double virt_phero = this->ReadPheromone(row[i], true);
+    
+    cur_pheromone = 0;
+    if (virt && virt_phero > phero) {
+      if (virt_phero > this->config->min_pheromone)
+        cur_pheromone = pow(virt_phero, beta)/ total_pheromone;
     } else {
-      if (p_it->second.pheromone > this->config->min_pheromone)
-        cur_pheromone = pow(p_it->second.pheromone, beta)/ total_pheromone;
+      if (phero > this->config->min_pheromone)
+        cur_pheromone = pow(phero, beta)/ total_pheromone;
     }
     
     if (cur_pheromone > pow(this->config->min_pheromone, beta)) {
-      NS_LOG_FUNCTION("Appending" << nb_it->first 
-        << p_it->second.pheromone << cur_pheromone);
+      NS_LOG_FUNCTION("Appending" << this->nb_index[i] 
+        << phero << cur_pheromone);
       
-      pv.push_back(std::make_pair(nb_it->first, cur_pheromone));
+      pv.push_back(std::make_pair(this->nb_index[i], cur_pheromone));
       size++;
     }
   }
   return size;
 }
 
-double RoutingTable::EvaporatePheromone(double ph_value) {
-  return ph_value - (1- this->config->alpha) * ph_value;
+RoutingTableEntry* RoutingTable::GetRow(uint32_t dst_index) {
+  return &this->rtable[dst_index * this->nb_stride];
+}
+
+RoutingTableEntry* RoutingTable::FindEntry(Ipv4Address dst, Ipv4Address nb) {
+  
+  auto dst_it = this->dsts.find(dst);
+  if (!this->IsDestination(dst_it))
+    return 0;
+  
+  auto nb_it = this->nbs.find(nb);
+  if (!this->IsNeighbor(nb_it))
+    return 0;
+  
+  return &this->GetRow(dst_it->second.index)[nb_it->second.index];
+}
+
+bool RoutingTable::IsEmpty(const RoutingTableEntry& entry) const {
+  return (entry.pheromone == 0 && entry.virtual_pheromone == 0);
+}
+
+void RoutingTable::GrowNeighborColumns() {
+  
+  // Double the row length and copy every row into its new place
+  uint32_t new_stride = 2 * this->nb_stride;
+  PheromoneTable new_table(this->dst_index.size() * new_stride);
+  
+  for (uint32_t d = 0; d < this->dst_index.size(); d++) {
+    for (uint32_t i = 0; i < this->nb_stride; i++) {
+      new_table[d * new_stride + i] = this->rtable[d * this->nb_stride + i];
+    }
+  }
+  
+  NS_LOG_FUNCTION(this << "grow columns to" << new_stride);
+  
+  this->rtable.swap(new_table);
+  this->nb_stride = new_stride;
+}
+
+void RoutingTable::LinkEntry(uint32_t row, uint32_t col) {
+  
+  std::vector<uint32_t>& rows = this->nb_dsts[col];
+  this->GetRow(row)[col].nb_pos = rows.size();
+  rows.push_back(row);
+}
+
+void RoutingTable::UnlinkEntry(uint32_t row, uint32_t col) {
+  
+  // Swap with the last element of the list
+  std::vector<uint32_t>& rows = this->nb_dsts[col];
+  uint32_t pos = this->GetRow(row)[col].nb_pos;
+  uint32_t last = rows.back();
+  
+  rows[pos] = last;
+  this->GetRow(last)[col].nb_pos = pos;
+  rows.pop_back();
+  
+  this->GetRow(row)[col].nb_pos = NO_POSITION;
+}
+
+void RoutingTable::EntryChanged(DestinationInfo& dst_info, uint32_t col) {
+  
+  this->InvalidateRoutes(dst_info);
+  
+  const RoutingTableEntry& entry = this->GetRow(dst_info.index)[col];
+  
+  // Keep the destination list of the neighbor up to date
+  if (!this->IsEmpty(entry) && entry.nb_pos == NO_POSITION)
+    this->LinkEntry(dst_info.index, col);
+  else if (this->IsEmpty(entry) && entry.nb_pos != NO_POSITION)
+    this->UnlinkEntry(dst_info.index, col);
+  dst_info.best[0].Update(col, this->PheromoneRank(entry, false));
+  dst_info.best[1].Update(col, this->PheromoneRank(entry, true));
+}
+
+const BestPheromone& RoutingTable::GetBest(DestinationInfo& dst_info, 
+                                           bool virt) {
+  
+  BestPheromone& best = dst_info.best[virt ? 1 : 0];
+  if (!best.dirty)
+    return best;
+  
+  // Rebuild from the row
+  best.Reset();
+  RoutingTableEntry* row = this->GetRow(dst_info.index);
+  for (uint32_t i = 0; i < this->nb_index.size(); i++) {
+    if (this->IsEmpty(row[i]))
+      continue;
+    best.Update(i, this->PheromoneRank(row[i], virt));
+  }
+  
+  return best;
+}
+
+void RoutingTable::InvalidateRoutes(DestinationInfo& dst_info) {
+  dst_info.route_cache[0].valid = false;
+  dst_info.route_cache[1].valid = false;
+  dst_info.fuzzy_cache[0].valid = false;
+  dst_info.fuzzy_cache[1].valid = false;
+}
+
+void RoutingTable::BuildRouteCache(NextHopCache& cache, Ipv4Address dst, 
+                                   double beta, bool virt) {
+  
+  ProbVect pv;
+  this->GetProbVector(pv, dst, beta, virt);
+  cache.table.Build(pv);
+  
+  // Evaporation scales all entries alike, the distribution
+  // only changes, once an entry drops below min_pheromone
+  cache.valid_until = Time::Max();
+  RoutingTableEntry* row = this->GetRow(this->dsts.find(dst)->second.index);
+  for (uint32_t i = 0; i < this->nb_index.size(); i++) {
+    
+    if (this->IsEmpty(row[i]))
+      continue;
+    
+    double phero = row[i].pheromone;
+    if (virt && row[i].virtual_pheromone > phero)
+      phero = row[i].virtual_pheromone;
+    
+    Time decay_time = this->GetDecayTime(row[i], phero);
+    if (decay_time > Simulator::Now() && decay_time < cache.valid_until)
+      cache.valid_until = decay_time;
+  }
+  
+  cache.beta = beta;
+  cache.valid = true;
+}
+
+double RoutingTable::EvaporatePheromone(double ph_value, 
+                                        Time last_update) const {
+  
+  Time interval = this->config->evaporation_interval;
+  if (interval.IsZero() || ph_value == 0)
+    return ph_value;
+  
+  // Every interval, the pheromone is reduced by alpha
+  double steps = (Simulator::Now() - last_update).GetSeconds() 
+    / interval.GetSeconds();
+  return ph_value * std::pow(this->config->alpha, steps);
+}
+
+double RoutingTable::ReadPheromone(const RoutingTableEntry& entry, 
+                                   bool virt) const {
+  double ph_value = (virt) ? entry.virtual_pheromone : entry.pheromone;
+  return this->EvaporatePheromone(ph_value, entry.last_update);
+}
+
+void RoutingTable::MaterializeEntry(RoutingTableEntry& entry) {
+  entry.pheromone = this->ReadPheromone(entry, false);
+  entry.virtual_pheromone = this->ReadPheromone(entry, true);
+  entry.last_update = Simulator::Now();
+}
+
+double RoutingTable::PheromoneRank(const RoutingTableEntry& entry, 
+                                   bool virt) const {
+  
+  double ph_value = (virt) ? entry.virtual_pheromone : entry.pheromone;
+  if (ph_value <= 0)
+    return -std::numeric_limits<double>::infinity();
+  
+  // log of the pheromone, evaporated back to time zero.
+  // The order of ranks does not change, while the entries evaporate.
+  double rank = std::log(ph_value);
+  Time interval = this->config->evaporation_interval;
+  if (!interval.IsZero()) {
+    rank -= entry.last_update.GetSeconds() / interval.GetSeconds()
+      * std::log(this->config->alpha);
+  }
+  return rank;
+}
+
+Time RoutingTable::GetDecayTime(const RoutingTableEntry& entry, 
+                                double ph_value) const {
+  
+  Time interval = this->config->evaporation_interval;
+  if (interval.IsZero() || this->config->alpha >= 1.0 
+    || ph_value <= this->config->min_pheromone)
+    return Time::Max();
+  
+  double steps = std::log(this->config->min_pheromone / ph_value) 
+    / std::log(this->config->alpha);
+  return entry.last_update + Seconds(steps * interval.GetSeconds());
 }
 
 double RoutingTable::IncressPheromone(double ph_value, double update) {
@@ -874,9 +1608,11 @@ void RoutingTable::Print(std::ostream& os) const {
     for (auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
       os << " NB:(" << nb_it->first << " ";
       
-      auto p_it = this->rtable.find(std::make_pair(dst_it->first, nb_it->first));
-      if (p_it != this->rtable.end())
-        os << p_it->second.pheromone << "|" << p_it->second.virtual_pheromone;
+      const RoutingTableEntry& entry = this->rtable[dst_it->second.index 
+        * this->nb_stride + nb_it->second.index];
+      if (!this->IsEmpty(entry))
+        os << this->ReadPheromone(entry, false) << "|" 
+          << this->ReadPheromone(entry, true);
       else 
         os << "None";
       
@@ -884,6 +1620,8 @@ void RoutingTable::Print(std::ostream& os) const {
     }
     os << "]" << std::endl;
   }
+  
+  this->housekeeping_stats.Print(os);
 }
 
 std::ostream& operator<< (std::ostream& os, RoutingTable const& t) {
@@ -896,6 +1634,18 @@ std::ostream& operator<< (std::ostream& os, RoutingTable const& t) {
 // Fuzzy experiments
 
 double RoutingTable::GetNbTrust(Ipv4Address nb) {
+  
+  // Use the cached value, if the statistic has not changed since
+  auto nb_it = this->nbs.find(nb);
+  if (this->IsNeighbor(nb_it)) {
+    NeighborInfo& nb_info = nb_it->second;
+    if (nb_info.trust != -1
+      && nb_info.trust_version == this->stat.GetVersion(nb)
+      && Simulator::Now() < nb_info.trust_time + this->config->trust_ttl) {
+      return nb_info.trust;
+    }
+  }
+  
   double fullfill = this->stat.GetFullfillmentRate(nb);
   double data_amount = this->stat.GetNumberOfData(nb);
   
@@ -903,9 +1653,52 @@ double RoutingTable::GetNbTrust(Ipv4Address nb) {
   
   NS_LOG_FUNCTION("NB FRate AmountData and Trust"
    << nb << fullfill << data_amount << trust);
+  
+  if (this->IsNeighbor(nb_it)) {
+    
+    nb_it->second.trust_time = Simulator::Now();
+    nb_it->second.trust_version = this->stat.GetVersion(nb);
+    
+    // A changed trust value invalidates the fuzzy distributions
+    if (nb_it->second.trust != trust 
+      && !(std::isnan(nb_it->second.trust) && std::isnan(trust))) {
+      nb_it->second.trust = trust;
+      this->trust_epoch++;
+    }
+  }
+  
   return trust;
 }
 
+void RoutingTable::StatChanged(Ipv4Address nb) {
+  
+  auto nb_it = this->nbs.find(nb);
+  if (!this->IsNeighbor(nb_it) || nb_it->second.trust_dirty)
+    return;
+  
+  nb_it->second.trust_dirty = true;
+  this->trust_dirty.push_back(nb);
+}
+
+void RoutingTable::RefreshDirtyTrust() {
+  
+  // Evaluating the trust reads the statistic, which might queue 
+  // neighbors again. They are refreshed on the next call.
+  std::vector<Ipv4Address>& dirty = this->trust_dirty_scratch;
+  dirty.swap(this->trust_dirty);
+  
+  for (uint32_t i = 0; i < dirty.size(); i++) {
+    auto nb_it = this->nbs.find(dirty[i]);
+    if (!this->IsNeighbor(nb_it))
+      continue;
+    
+    nb_it->second.trust_dirty = false;
+    this->GetNbTrust(dirty[i]);
+  }
+  
+  dirty.clear();
+}
+
 bool RoutingTable::SelectRouteFuzzy(Ipv4Address dst, double beta,
                                     Ipv4Address& nb, Ptr<UniformRandomVariable> vr,
                                     bool virt) {
@@ -918,49 +1711,80 @@ bool RoutingTable::SelectRouteFuzzy(Ipv4Address dst, double beta,
     return false;
   }
   
+  if (!this->trust_dirty.empty())
+    this->RefreshDirtyTrust();
+  
+  NextHopCache& cache = dst_it->second.fuzzy_cache[virt ? 1 : 0];
+  if (!cache.valid || cache.beta != beta 
+      || cache.trust_epoch != this->trust_epoch
+      || Simulator::Now() >= cache.valid_until) {
+    
+    // Refresh the trust of all neighbors we have pheromone for.
+    // This might raise trust_epoch, the cache is built afterwards.
+    RoutingTableEntry* row = this->GetRow(dst_it->second.index);
+    for (uint32_t i = 0; i < this->nb_index.size(); i++) {
+      
+      if (this->ReadPheromone(row[i], virt) > this->config->min_pheromone)
+        this->GetNbTrust(this->nb_index[i]);
+    }
+    
+    this->BuildFuzzyRouteCache(cache, dst_it->second, beta, virt);
+  }
+  
+  if (cache.table.IsEmpty())
+    return false;
+  
+  // Select as in normal select route
+  nb = cache.table.Sample(vr->GetValue(0.0, 1.0));
+  return true;
+  
+}
+
+void RoutingTable::BuildFuzzyRouteCache(NextHopCache& cache, 
+                                        DestinationInfo& dst_info,
+                                        double beta, bool virt) {
+  
   ProbVect tv;
-  double total_pheromone = 0;
+  cache.valid_until = Time::Max();
   
+  RoutingTableEntry* row = this->GetRow(dst_info.index);
   for (auto nb_it = this->nbs.begin(); nb_it != this->nbs.end(); ++nb_it) {
     
+    RoutingTableEntry& entry = row[nb_it->second.index];
+    double phero = this->ReadPheromone(entry, virt);
+    
     // If no pheromone at all, no need to evaulate further
-    if (!this->HasPheromone(dst, nb_it->first, virt))
+    if (phero <= this->config->min_pheromone)
       continue;
     
+    Time decay_time = this->GetDecayTime(entry, 
+      (virt) ? entry.virtual_pheromone : entry.pheromone);
+    if (decay_time < cache.valid_until)
+      cache.valid_until = decay_time;
+    
+    // The trust is reevaluated after trust_ttl
+    Time trust_expire = nb_it->second.trust_time + this->config->trust_ttl;
+    if (trust_expire < cache.valid_until)
+      cache.valid_until = trust_expire;
+    
     // Ignore neighbors, you do not trust at all
-    double trust = this->GetNbTrust(nb_it->first);
+    double trust = nb_it->second.trust;
     if (trust < this->config->trust_threshold)
       continue;
     
-    double phero = this->GetPheromone(dst, nb_it->first, virt);
-    
     // Calculate corrected pheromone
     phero = phero * trust;
     phero = pow(phero, beta);
     
     tv.push_back(std::make_pair(nb_it->first, phero));
-    total_pheromone += phero;
   }
   
-  // Normalize the vector
-  for (auto tv_it = tv.begin(); tv_it != tv.end(); ++tv_it) {
-    tv_it->second /= total_pheromone;
-  }
-  
-  // Select as in normal select route
-  double select = vr->GetValue(0.0, 1.0);
-  double selected = 0.0;
-  
-  for (auto tv_it = tv.begin(); tv_it != tv.end(); ++tv_it) {
-    selected += tv_it->second;
-    if (selected > select) {
-      nb = tv_it->first;
-      return true;
-    } 
-  }
-  
-  return false;
+  // The alias table normalizes the vector
+  cache.table.Build(tv);
   
+  cache.beta = beta;
+  cache.trust_epoch = this->trust_epoch;
+  cache.valid = true;
 }
 
 
@@ -21,11 +21,14 @@
 
 #include <map>
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <iomanip>
 
 #include <set>
 
 #include <cmath>
+#include <limits>
 
 #include "ns3/node.h"
 #include "ns3/random-variable-stream.h"
@@ -33,6 +36,7 @@
 #include "ns3/ipv4-address.h"
 #include "ns3/ipv4-route.h"
 #include "ns3/timer.h"
+#include "ns3/callback.h"
 #include "ns3/net-device.h"
 #include "ns3/output-stream-wrapper.h"
 #include "ns3/simulator.h"
@@ -42,8 +46,20 @@
 #include "anthocnet-config.h"
 #include "anthocnet-stat.h"
 
+// Reads the pheromone over time
+class AnthocnetEvaporationTestCase;
+// Checks the slots of the pheromone matrix
+class AnthocnetHousekeepingTestCase;
+// Checks the neighbor expiry wheel
+class AnthocnetNeighborWheelTestCase;
+
 namespace ns3 {
 namespace ahn {
+
+// Marks an unused column in the best pheromone index
+#define NO_COLUMN 0xFFFFFFFF
+// Marks an entry, which is not listed by its neighbor
+#define NO_POSITION 0xFFFFFFFF
   
 
 
@@ -53,12 +69,22 @@ public:
   RoutingTableEntry();
   ~RoutingTableEntry();
   
+  // Zero the pheromone values, keeps the position
+  void Clear();
+  
   // The pheromone value of a connection
   double pheromone;
   
   // The virtual pheromone value aquired trough the dissimination part
   double virtual_pheromone;
   
+  // Position of this entry in the destination list of its neighbor
+  uint32_t nb_pos;
+  
+  // Time, the pheromone values were written last. 
+  // They are evaporated from this point on, when read.
+  Time last_update;
+  
 };
 
 class NeighborInfo {
@@ -71,8 +97,102 @@ public:
   
   double last_snr;
   
+  // Last trust value evaluated for this neighbor.
+  // Reevaluated after trust_ttl or if the statistic changed.
+  double trust;
+  Time trust_time;
+  uint64_t trust_version;
+  // Set, while the neighbor waits in RoutingTable::trust_dirty
+  bool trust_dirty;
+  
+  // Last time, the neighbor was heard of
+  Time last_seen;
+  
+  // Distinguishes this neighbor from an earlier one with the same address
+  uint64_t generation;
+  
+  // Set, while the neighbor is in the expiry wheel
+  bool in_wheel;
+  
+  // Column of this neighbor in the pheromone matrix
+  uint32_t index;
+  
+};
+
+
+typedef std::vector<std::pair<Ipv4Address, double> > ProbVect;
+typedef ProbVect::iterator ProbVectIt;
+
+// Walker/Vose alias table over a set of next hops.
+// Draws a next hop in constant time, independent of the number of hops.
+class AliasTable {
+public:
+  
+  AliasTable();
+  ~AliasTable();
+  
+  // Build from (not necessarily normalized) weights
+  void Build(const ProbVect& pv);
+  void Clear();
+  bool IsEmpty() const;
+  
+  // Select a next hop, select is uniform in [0,1)
+  Ipv4Address Sample(double select) const;
+  
+private:
+  
+  std::vector<double> prob;
+  std::vector<uint32_t> alias;
+  std::vector<Ipv4Address> hops;
+  
+  // Worklists used during Build, kept to avoid reallocation
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
 };
 
+// Next hop distribution to a destination.
+// It is built on demand and stays valid until a pheromone 
+// value towards the destination (or a trust value) changes.
+class NextHopCache {
+public:
+  
+  NextHopCache();
+  ~NextHopCache();
+  
+  bool valid;
+  double beta;
+  uint64_t trust_epoch;
+  
+  // Evaporation keeps the distribution, until the first
+  // included entry falls below min_pheromone
+  Time valid_until;
+  
+  AliasTable table;
+};
+
+// Best and second best pheromone of one kind towards a destination.
+// Increases are tracked in constant time. If a tracked value decreases,
+// the index is marked dirty and rebuilt from the row on the next read.
+// The values are ranks (see RoutingTable::PheromoneRank), which keep 
+// their order while the pheromone evaporates.
+class BestPheromone {
+public:
+  
+  BestPheromone();
+  ~BestPheromone();
+  
+  void Reset();
+  
+  // Track the new value of the entry in column col
+  void Update(uint32_t col, double value);
+  
+  uint32_t first;
+  double first_value;
+  uint32_t second;
+  double second_value;
+  
+  bool dirty;
+};
 
 class DestinationInfo {
 public:
@@ -88,6 +208,17 @@ public:
   Time session_time;
   bool session_active;
   
+  // Row of this destination in the pheromone matrix
+  uint32_t index;
+  
+  // Next hop distributions for real [0] and virtual [1] pheromone.
+  // In practice, these are the cons_beta and prog_beta selections.
+  NextHopCache route_cache[2];
+  NextHopCache fuzzy_cache[2];
+  
+  // Best real [0] and virtual [1] pheromone values
+  BestPheromone best[2];
+  
 };
 
 typedef std::map<Ipv4Address, DestinationInfo> DstMap;
@@ -96,17 +227,57 @@ typedef DstMap::iterator DstIt;
 typedef std::map<Ipv4Address, NeighborInfo> NbMap;
 typedef NbMap::iterator NbIt;
 
-typedef std::map<std::pair<Ipv4Address, Ipv4Address>, RoutingTableEntry> PheromoneTable;
+// Dense storage, see RoutingTable::rtable
+typedef std::vector<RoutingTableEntry> PheromoneTable;
 typedef PheromoneTable::iterator PheromoneIt;
 
-typedef std::set<std::pair<Ipv4Address, uint64_t> > AntHist;
+// Sliding window over the ant sequence numbers seen from one source.
+// Bit (seqno % size) is set if seqno has been seen. Sequence numbers
+// older than the window are considered seen.
+class AntHistWindow {
+public:
+  
+  AntHistWindow();
+  ~AntHistWindow();
+  
+  void Init(uint32_t window_size);
+  bool Has(uint64_t seqno) const;
+  void Add(uint64_t seqno);
+  
+  // Last time an ant of this source was registered
+  Time last_seen;
+  
+private:
+  
+  uint64_t highest;
+  bool empty;
+  std::vector<uint64_t> bits;
+};
+
+typedef std::map<Ipv4Address, AntHistWindow> AntHist;
 typedef AntHist::iterator AntHistIt;
 
-typedef std::map<Ipv4Address, Timer> NbTimers;
-typedef NbTimers::iterator NbTimersIt;
+// What the housekeeping of the RoutingTable has reclaimed so far
+class HousekeepingStats {
+public:
+  
+  HousekeepingStats();
+  ~HousekeepingStats();
+  
+  void Print(std::ostream& os) const;
+  
+  // Complete cycles over all destinations
+  uint64_t passes;
+  
+  uint64_t dsts_visited;
+  uint64_t sessions_expired;
+  uint64_t entries_cleared;
+  uint64_t dsts_removed;
+  uint64_t history_purged;
+};
 
-typedef std::vector<std::pair<Ipv4Address, double> > ProbVect;
-typedef ProbVect::iterator ProbVectIt;
+// A slot of the neighbor expiry wheel holds (neighbor, generation) pairs
+typedef std::vector<std::pair<Ipv4Address, uint64_t> > NbWheelSlot;
 
 typedef std::map<Ipv4Address, double> TrustVect;
 typedef TrustVect::iterator TrustVectIt;
@@ -188,19 +359,22 @@ public:
   bool HasHistory(Ipv4Address dst, uint64_t seqno);
   void AddHistory(Ipv4Address dst, uint64_t seqno);
   
+  // Remove the history of sources not heard of for history_expire.
+  // Returns the number of removed sources.
+  uint32_t PurgeHistory();
+  
+  // Visit the next max_dsts destinations, expire their sessions,
+  // clear dead pheromone entries and drop unused destinations.
+  // The history is purged after every complete cycle.
+  void Housekeeping(uint32_t max_dsts);
+  const HousekeepingStats& GetHousekeepingStats() const;
+  
   void SetIpv4(Ptr<Ipv4> ipv4) {
     this->ipv4 = ipv4;
   }
   
-  // This is used to set RoutingProtocols function as callback inside RoutingTable
-  template <typename MEM_PTR, typename OBJ_PTR>
-  void InitNeighborTimer(Ipv4Address nb, MEM_PTR memPtr, OBJ_PTR objPtr) {
-    auto nbt_it = this->nb_timers.find(nb);
-    if (nbt_it == this->nb_timers.end())
-      return;
-    nbt_it->second.SetFunction(memPtr, objPtr);
-    nbt_it->second.SetArguments(nb);
-  }
+  // Called, when a neighbor was not heard of for nb_expire
+  void SetNeighborExpireCallback(Callback<void, Ipv4Address> cb);
   
   void Print(Ptr<OutputStreamWrapper> stream) const;
   void Print(std::ostream& os) const;
@@ -212,6 +386,9 @@ public:
   AntHocNetStat stat;
   
 private:
+  friend class ::AnthocnetEvaporationTestCase;
+  friend class ::AnthocnetHousekeepingTestCase;
+  friend class ::AnthocnetNeighborWheelTestCase;
   
   // Util functions
   double Bootstrap(double ph_value, double update);
@@ -221,22 +398,99 @@ private:
   double SumPropability(Ipv4Address dst, double beta, bool virt);
   uint32_t GetProbVector(ProbVect& pv, Ipv4Address dst, double beta, bool virt);
   
-  double EvaporatePheromone(double ph_value);
+  // Evaporation is applied, whenever an entry is read
+  double EvaporatePheromone(double ph_value, Time last_update) const;
+  double ReadPheromone(const RoutingTableEntry& entry, bool virt) const;
+  void MaterializeEntry(RoutingTableEntry& entry);
+  double PheromoneRank(const RoutingTableEntry& entry, bool virt) const;
+  Time GetDecayTime(const RoutingTableEntry& entry, double ph_value) const;
   double IncressPheromone(double ph_value, double update);
   
   double GetNbTrust(Ipv4Address nb);
   
+  // Called by the statistic, queues the neighbor for a trust refresh
+  void StatChanged(Ipv4Address nb);
+  
+  // Reevaluates the trust of the queued neighbors. Only a changed 
+  // trust value invalidates the fuzzy distributions.
+  void RefreshDirtyTrust();
+  
+  // Access to the dense pheromone matrix
+  RoutingTableEntry* GetRow(uint32_t dst_index);
+  RoutingTableEntry* FindEntry(Ipv4Address dst, Ipv4Address nb);
+  bool IsEmpty(const RoutingTableEntry& entry) const;
+  void GrowNeighborColumns();
+  void LinkEntry(uint32_t row, uint32_t col);
+  void UnlinkEntry(uint32_t row, uint32_t col);
+  
+  // Must be called after the entry in column col of a destination changed
+  void EntryChanged(DestinationInfo& dst_info, uint32_t col);
+  void InvalidateRoutes(DestinationInfo& dst_info);
+  
+  // Neighbor expiry wheel
+  int64_t InsertNeighborWheel(Ipv4Address nb, NeighborInfo& nb_info);
+  void ScheduleNeighborWheel();
+  void NeighborWheelExpire();
+  const BestPheromone& GetBest(DestinationInfo& dst_info, bool virt);
+  void BuildRouteCache(NextHopCache& cache, Ipv4Address dst, 
+                       double beta, bool virt);
+  void BuildFuzzyRouteCache(NextHopCache& cache, DestinationInfo& dst_info,
+                            double beta, bool virt);
+  
   DstMap dsts;
   NbMap nbs;
   
+  // The pheromone matrix. Every destination owns a contiguous row
+  // of nb_stride entries, every neighbor owns a column in each row.
+  // An entry with both pheromone values zero does not exist.
   PheromoneTable rtable;
+  uint32_t nb_stride;
+  
+  // Maps row and column indices back to their addresses.
+  // Indices of removed destinations and neighbors are reused.
+  std::vector<Ipv4Address> dst_index;
+  std::vector<Ipv4Address> nb_index;
+  std::vector<uint32_t> free_dst_index;
+  std::vector<uint32_t> free_nb_index;
   
+  // Per column, the rows in which the neighbor has a non empty entry.
+  // Lets neighbor removal touch only the entries that exist.
+  std::vector<std::vector<uint32_t> > nb_dsts;
+  
+  // Candidate buffer of ConstructHelloMsg
+  std::vector<std::pair<Ipv4Address, double> > hello_selection;
+  
+  // Duplicate detection of ants, one window per source.
+  // Bounded by history_max_sources and history_expire.
   AntHist history;
   
-  NbTimers nb_timers;
+  // Expiry of neighbors. UpdateNeighbor only refreshes last_seen,
+  // a neighbor is checked when its slot comes up and moved on if it 
+  // has been seen in the meantime. One timer serves all neighbors and
+  // fires only for non empty slots.
+  std::vector<NbWheelSlot> nb_wheel;
+  Timer nb_wheel_timer;
+  // Last processed tick and the tick the timer is set for
+  int64_t nb_wheel_tick;
+  int64_t nb_wheel_next;
+  uint32_t nb_wheel_count;
+  uint64_t nb_generation;
+  Callback<void, Ipv4Address> nb_expire_cb;
+  
+  // Last destination visited by the housekeeping
+  Ipv4Address housekeeping_cursor;
+  HousekeepingStats housekeeping_stats;
   
   uint64_t seqno;
   
+  // Incremented, whenever the trust of a neighbor or
+  // the statistic it is derived from changes
+  uint64_t trust_epoch;
+  
+  // Neighbors, whose statistic changed since their trust was evaluated
+  std::vector<Ipv4Address> trust_dirty;
+  std::vector<Ipv4Address> trust_dirty_scratch;
+  
   // The IP protocol
   Ptr<Ipv4> ipv4;
   Ptr<AntHocNetConfig> config;
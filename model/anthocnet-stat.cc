@@ -15,11 +15,121 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <algorithm>
+
 #include "anthocnet-stat.h"
 
 namespace ns3 {
 namespace ahn {
   
+OutcomeWindow::OutcomeWindow() :
+  head(0),
+  size(0),
+  fullfilled(0),
+  old(0),
+  weight(0),
+  fullfilled_weight(0),
+  old_weight(0)
+  {}
+
+OutcomeWindow::~OutcomeWindow() {
+}
+
+void OutcomeWindow::Init(uint32_t capacity) {
+  
+  if (capacity == 0)
+    capacity = 1;
+  
+  this->ring.assign(capacity, outcome_t());
+  this->head = 0;
+  this->size = 0;
+  this->fullfilled = 0;
+  this->old = 0;
+  this->weight = 0;
+  this->fullfilled_weight = 0;
+  this->old_weight = 0;
+}
+
+void OutcomeWindow::Push(Time included, bool fullfilled, double weight) {
+  
+  uint32_t capacity = this->ring.size();
+  
+  // Drop the oldest outcome
+  if (this->size == capacity) {
+    outcome_t& oldest = this->ring[this->head];
+    this->weight -= oldest.weight;
+    if (oldest.fullfilled) {
+      this->fullfilled--;
+      this->fullfilled_weight -= oldest.weight;
+    }
+    if (this->old > 0) {
+      this->old--;
+      this->old_weight -= oldest.weight;
+    }
+    
+    // Do not let rounding errors pile up
+    if (this->size == 1) {
+      this->weight = 0;
+      this->fullfilled_weight = 0;
+      this->old_weight = 0;
+    }
+    
+    this->head = (this->head + 1) % capacity;
+    this->size--;
+  }
+  
+  outcome_t& outcome = this->ring[(this->head + this->size) % capacity];
+  outcome.included = included;
+  outcome.fullfilled = fullfilled;
+  outcome.weight = weight;
+  
+  this->size++;
+  this->weight += weight;
+  if (fullfilled) {
+    this->fullfilled++;
+    this->fullfilled_weight += weight;
+  }
+}
+
+bool OutcomeWindow::Age(Time limit) {
+  
+  uint32_t capacity = this->ring.size();
+  uint32_t old = this->old;
+  while (this->old < this->size 
+    && this->ring[(this->head + this->old) % capacity].included <= limit) {
+    this->old_weight += this->ring[(this->head + this->old) % capacity].weight;
+    this->old++;
+  }
+  
+  return this->old != old;
+}
+
+uint32_t OutcomeWindow::GetSize() const {
+  return this->size;
+}
+
+uint32_t OutcomeWindow::GetFullfilled() const {
+  return this->fullfilled;
+}
+
+uint32_t OutcomeWindow::GetYoung() const {
+  return this->size - this->old;
+}
+
+double OutcomeWindow::GetWeight() const {
+  return this->weight;
+}
+
+double OutcomeWindow::GetFullfilledWeight() const {
+  return this->fullfilled_weight;
+}
+
+double OutcomeWindow::GetYoungWeight() const {
+  if (this->old == this->size)
+    return 0;
+  return std::max(this->weight - this->old_weight, 0.0);
+}
+
 AntHocNetStat::AntHocNetStat() {}
 AntHocNetStat::~AntHocNetStat() {}
 
@@ -33,18 +143,16 @@ void AntHocNetStat::Expect(Ipv4Address nextHop, Ipv4Address src,
   
   auto nb_it = this->expecting.find(nextHop);
   if (nb_it == this->expecting.end()) {
-    this->expecting.insert(std::make_pair(nextHop, std::list<expect_type_t>()));
+    this->expecting.insert(std::make_pair(nextHop, nb_expect_t()));
     nb_it = this->expecting.find(nextHop);
+    nb_it->second.rate = this->sampling;
   }
   
-  size_t packet_size = packet->GetSerializedSize();
-  
-  uint8_t* uptr = this->buffer;
-  char* cptr = (char*) uptr;
-  
-  if (!packet->Serialize(uptr, STAT_MAX_PKT_SIZE)) {
+  // Only a sample of the packets is watched
+  uint32_t hash = AntHocNetStat::Fingerprint(packet);
+  double rate = nb_it->second.rate;
+  if (rate < 1 && AntHocNetStat::SampleValue(hash) >= rate)
     return;
-  }
   
   // Fill in the data including the hash
   expect_type_t et;
@@ -52,9 +160,20 @@ void AntHocNetStat::Expect(Ipv4Address nextHop, Ipv4Address src,
   et.included = Simulator::Now();
   et.src = src;
   et.dst = dst;
-  et.hash = Hash32(cptr, packet_size);
+  et.hash = hash;
+  et.fullfilled = false;
+  et.weight = 1 / rate;
+  
+  nb_it->second.filter_rate = std::max(nb_it->second.filter_rate, rate);
+  
+  // Decide the timed out expectations while the traffic flows, such that
+  // a neighbor dropping everything is noticed without any replay
+  this->DecideExpect(nextHop, nb_it->second);
   
-  nb_it->second.push_back(et);
+  nb_it->second.queue.push_back(et);
+  
+  expect_key_t key = {src, dst, et.hash};
+  nb_it->second.index.insert(std::make_pair(key, --nb_it->second.queue.end()));
   
 }
 
@@ -62,141 +181,189 @@ void AntHocNetStat::Fullfill(Ipv4Address nextHop, Ipv4Address src,
                              Ipv4Address dst, Ptr<Packet const> packet) {
   
   auto nb_it = this->expecting.find(nextHop);
+  if (nb_it == this->expecting.end())
+    return;
   
-  for (auto ex_it = nb_it->second.begin(); ex_it != nb_it->second.end(); ++ex_it) {
-    if (src != ex_it->src)
-      continue;
-      
-    if (dst != ex_it->dst)
-      continue;
-    
-    size_t packet_size = packet->GetSerializedSize();
+  // Packets, that were not sampled, are rejected without a lookup
+  uint32_t hash = AntHocNetStat::Fingerprint(packet);
+  if (nb_it->second.filter_rate < 1 
+    && AntHocNetStat::SampleValue(hash) >= nb_it->second.filter_rate)
+    return;
   
-    uint8_t* uptr = this->buffer;
-    char* cptr = (char*) uptr;
-    
-    if (Hash32(cptr, packet_size) != ex_it->hash)
-      continue;
-    
-    // If we passed the tree tests, we have found a replayed packet
+  expect_key_t key = {src, dst, hash};
+  auto range = nb_it->second.index.equal_range(key);
+  if (range.first == range.second)
+    return;
+  
+  // If the same packet is expected more than once, the oldest one is replayed
+  auto match = range.first;
+  for (auto idx_it = range.first; idx_it != range.second; ++idx_it) {
+    if (idx_it->second->included < match->second->included)
+      match = idx_it;
+  }
+  
+  // It can not be replayed again, it moves into the outcomes 
+  // once it times out
+  match->second->fullfilled = true;
+  nb_it->second.index.erase(match);
+  
+  this->DecideExpect(nextHop, nb_it->second);
+}
+
+void AntHocNetStat::PopExpect(nb_expect_t& nb) {
+  
+  auto ex_it = nb.queue.begin();
+  
+  // Fullfilled entries are already gone from the index
+  if (!ex_it->fullfilled) {
+    expect_key_t key = {ex_it->src, ex_it->dst, ex_it->hash};
     
-    // Insert it into fullfilled list
-    auto f_it = this->fullfilled.find(nextHop);
-    if (f_it == this->fullfilled.end()) {
-      this->fullfilled.insert(std::make_pair(nextHop, PacketList()));
-      f_it = this->fullfilled.find(nextHop);
+    auto range = nb.index.equal_range(key);
+    for (auto idx_it = range.first; idx_it != range.second; ++idx_it) {
+      if (idx_it->second == ex_it) {
+        nb.index.erase(idx_it);
+        break;
+      }
     }
-    
-    f_it->second.push_back(ex_it->included);
-    
-    // Remove from expecting list
-    nb_it->second.erase(ex_it);
-    return;
   }
   
+  nb.queue.pop_front();
+  if (nb.queue.empty())
+    nb.filter_rate = 0;
+}
+
+double AntHocNetStat::SampleValue(uint32_t fingerprint) {
+  
+  // Mix again, so that sampling does not correlate with the index buckets
+  uint64_t h = (fingerprint ^ 0x5BD1E995ULL) * 0x9E3779B97F4A7C15ULL;
+  return (h >> 11) * (1.0 / (1ULL << 53));
+}
+
+void AntHocNetStat::SetChangeCallback(Callback<void, Ipv4Address> cb) {
+  this->change_cb = cb;
 }
 
-void AntHocNetStat::GetExpectingNbs(std::set<Ipv4Address>& nbs) {
+void AntHocNetStat::SetSampling(double rate, bool adaptive, double threshold) {
+  
+  this->sampling = rate;
+  this->adaptive_sampling = adaptive;
+  this->adaptive_threshold = threshold;
   
   for (auto nb_it = this->expecting.begin(); nb_it != this->expecting.end(); ++nb_it) {
-    if (nb_it->second.size() != 0) {
-      nbs.insert(nb_it->first);
-    }
+    nb_it->second.rate = rate;
+  }
+}
+
+void AntHocNetStat::DecideExpect(Ipv4Address nb, nb_expect_t& ex) {
+  
+  auto o_it = this->outcomes.find(nb);
+  if (o_it == this->outcomes.end()) {
+    o_it = this->outcomes.insert(std::make_pair(nb, OutcomeWindow())).first;
+    o_it->second.Init(this->packets_considered);
   }
   
+  // The queue is ordered by time, so we can stop at the first one,
+  // that has not timed out. Fullfilled packets wait as well, otherwise
+  // the window would prefer them over the undecided ones.
+  bool decided = false;
+  while (!ex.queue.empty()) {
+    expect_type_t& front = ex.queue.front();
+    if (front.included + this->expect_timeout >= Simulator::Now())
+      break;
+    
+    o_it->second.Push(front.included, front.fullfilled, front.weight);
+    this->PopExpect(ex);
+    decided = true;
+  }
+  
+  if (decided)
+    this->Changed(nb);
+}
+
+void AntHocNetStat::Changed(Ipv4Address nb) {
+  
+  this->version[nb]++;
+  if (!this->change_cb.IsNull())
+    this->change_cb(nb);
+}
+
+uint32_t AntHocNetStat::Fingerprint(Ptr<Packet const> packet) {
   
+  // Uids are consecutive, mix them so that the expect index
+  // gets well distributed hashes
+  uint64_t h = packet->GetUid() + 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+  h = h ^ (h >> 31);
+  
+  return (uint32_t) (h ^ (h >> 32));
+}
+
+bool AntHocNetStat::IsExpecting(Ipv4Address nb) const {
+  
+  auto nb_it = this->expecting.find(nb);
+  return nb_it != this->expecting.end() && !nb_it->second.queue.empty();
 }
 
 double AntHocNetStat::GetFullfillmentRate(Ipv4Address nb) {
   
   auto nb_it = this->expecting.find(nb);
-  auto f_it = this->fullfilled.find(nb);
-  auto uf_it = this->unfullfilled.find(nb);
+  auto o_it = this->outcomes.find(nb);
   
   // Return 1 if we do not have any data at all
   if (nb_it == this->expecting.end() 
-    && f_it == this->fullfilled.end()
-    && uf_it == this->unfullfilled.end()) {
+    && o_it == this->outcomes.end()) {
     return 1;
   }
   
-  // It is possible, that we do not have lists set up yet
+  // Put all timed out packets from expecting into the outcomes
   NS_ASSERT(nb_it != this->expecting.end());
-  if (f_it == this->fullfilled.end()) {
-    this->fullfilled.insert(std::make_pair(nb, PacketList()));
-    f_it = this->fullfilled.find(nb);
-  }
-  if (uf_it == this->unfullfilled.end()) {
-    this->unfullfilled.insert(std::make_pair(nb, PacketList()));
-    uf_it = this->unfullfilled.find(nb);
-  }
+  this->DecideExpect(nb, nb_it->second);
+  o_it = this->outcomes.find(nb);
   
-  // Put all unfullfilled packets from expecting into unfullfilled list
-  for (auto ex_it = nb_it->second.begin(); ex_it != nb_it->second.end(); /* no increment */) {
-    if (ex_it->included + this->expect_timeout < Simulator::Now()) {
-      uf_it->second.push_back(ex_it->included);
-      nb_it->second.erase(ex_it++);
-    }
-    else {
-      ex_it++;
-    }
+  // The window only holds the last packets_considered outcomes
+  if (o_it->second.GetSize() == 0) {
+    return 1;
   }
   
-  // Remove packets
-  uint32_t total_packets = f_it->second.size() + uf_it->second.size();
-  while (total_packets > this->packets_considered) {
-    
-    if (f_it->second.empty()) {
-      uf_it->second.pop_front();
-      total_packets--;
-      continue;
-    }
-    
-    if (uf_it->second.empty()) {
-      f_it->second.pop_front();
-      total_packets--;
-      continue;
-    }
-    
-    if (f_it->second.front() < uf_it->second.front()) 
-      f_it->second.pop_front();
-    else
-      uf_it->second.pop_front();
-    
-    total_packets--;
-  }
+  // Every outcome is weighted by its inverse sampling rate, so the
+  // rate stays unbiased while the sampling rate changes
+  double rate = o_it->second.GetFullfilledWeight() / o_it->second.GetWeight();
   
-  //NS_ASSERT((f_it->second.size() + uf_it->second.size()) != 0);
-  if ((f_it->second.size() + uf_it->second.size()) == 0) {
-    return 1;
+  // Watch a suspicious neighbor closer
+  if (this->adaptive_sampling) {
+    nb_it->second.rate = (rate < this->adaptive_threshold) ? 1 : this->sampling;
   }
   
-  return (double) f_it->second.size() / (f_it->second.size() + uf_it->second.size());
+  return rate;
   
   
 }
 
+uint64_t AntHocNetStat::GetVersion(Ipv4Address nb) const {
+  auto v_it = this->version.find(nb);
+  if (v_it == this->version.end())
+    return 0;
+  return v_it->second;
+}
+
 double AntHocNetStat::GetNumberOfData(Ipv4Address nb) {
   
-  uint32_t pkts = 0;
+  auto o_it = this->outcomes.find(nb);
+  if (o_it == this->outcomes.end())
+    return 0;
   
-  auto f_it = this->fullfilled.find(nb);
-  if (f_it != this->fullfilled.end()) {
-    for (auto t_it = f_it->second.begin(); t_it != f_it->second.end(); ++t_it) {
-      if (*t_it + this->consider_old > Simulator::Now())
-        pkts++;
-    }
-  }
+  if (o_it->second.Age(Simulator::Now() - this->consider_old))
+    this->Changed(nb);
   
-  f_it = this->unfullfilled.find(nb);
-  if (f_it != this->unfullfilled.end()) {
-    for (auto t_it = f_it->second.begin(); t_it != f_it->second.end(); ++t_it) {
-      if (*t_it + this->consider_old > Simulator::Now())
-        pkts++;
-    }
-  }
+  // Estimate the number of packets from the samples. Unsampled, the
+  // window holds packets_considered packets at most, scale down to that.
+  double young = o_it->second.GetYoungWeight();
+  double total = o_it->second.GetWeight();
+  if (total > this->packets_considered)
+    young *= this->packets_considered / total;
   
-  return (double) pkts;
+  return young;
 }
 
 
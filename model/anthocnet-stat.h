@@ -19,17 +19,17 @@
 
 #include <list>
 #include <map>
+#include <vector>
+#include <unordered_map>
 #include <cmath>
 
-#include "ns3/hash.h"
 #include "ns3/simulator.h"
+#include "ns3/callback.h"
 #include "ns3/address.h"
 #include "ns3/packet.h"
 #include "ns3/application.h"
 #include "ns3/ipv4-address.h"
 
-#define STAT_MAX_PKT_SIZE 2000
-
 namespace ns3 {
 namespace ahn {
 
@@ -38,10 +38,101 @@ typedef struct ExpectType {
   Ipv4Address src;
   Ipv4Address dst;
   uint32_t hash;
+  
+  // Replayed, but not yet moved into the outcomes
+  bool fullfilled;
+  
+  // Inverse of the sampling rate, the packet was watched with
+  double weight;
 } expect_type_t;
 
-typedef std::map <Ipv4Address, std::list<expect_type_t> > ExpectList;
-typedef std::list<Time> PacketList;
+// Identifies a forwarded packet, that we expect to be replayed
+typedef struct ExpectKey {
+  Ipv4Address src;
+  Ipv4Address dst;
+  uint32_t hash;
+  
+  bool operator==(const struct ExpectKey& other) const {
+    return this->hash == other.hash && this->src == other.src 
+      && this->dst == other.dst;
+  }
+} expect_key_t;
+
+struct ExpectKeyHash {
+  size_t operator()(const expect_key_t& key) const {
+    uint64_t h = ((uint64_t) key.src.Get() << 32) | key.dst.Get();
+    h ^= key.hash * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    return (size_t) h;
+  }
+};
+
+// The expectations of a neighbor are kept in the order they were
+// included, which is also the order in which they time out.
+// The index finds the entry of a replayed packet without a scan.
+typedef std::list<expect_type_t> ExpectQueue;
+typedef struct NbExpect {
+  NbExpect() : rate(1), filter_rate(0) {}
+  
+  ExpectQueue queue;
+  std::unordered_multimap<expect_key_t, ExpectQueue::iterator, ExpectKeyHash> index;
+  
+  // Current sampling rate of this neighbor and the highest rate of
+  // the packets in the queue. Overheard packets above it were never watched.
+  double rate;
+  double filter_rate;
+} nb_expect_t;
+
+typedef std::map <Ipv4Address, nb_expect_t> ExpectList;
+
+// The outcomes of the last expectations of a neighbor, in the order 
+// they were included. The ring has a fixed capacity and keeps the totals,
+// so that both queries of the statistic are constant time.
+class OutcomeWindow {
+public:
+  
+  OutcomeWindow();
+  ~OutcomeWindow();
+  
+  void Init(uint32_t capacity);
+  
+  // Adds an outcome, overwrites the oldest one if the ring is full.
+  // A sampled outcome stands for weight packets.
+  void Push(Time included, bool fullfilled, double weight = 1);
+  
+  // Skips the oldest outcomes, that were included before limit.
+  // Returns true, if any outcome became old.
+  bool Age(Time limit);
+  
+  uint32_t GetSize() const;
+  uint32_t GetFullfilled() const;
+  uint32_t GetYoung() const;
+  
+  // The same sums with every outcome weighted
+  double GetWeight() const;
+  double GetFullfilledWeight() const;
+  double GetYoungWeight() const;
+  
+private:
+  
+  typedef struct Outcome {
+    Time included;
+    bool fullfilled;
+    double weight;
+  } outcome_t;
+  
+  std::vector<outcome_t> ring;
+  uint32_t head;
+  uint32_t size;
+  uint32_t fullfilled;
+  
+  // Number of outcomes at the front, that are already too old
+  uint32_t old;
+  
+  double weight;
+  double fullfilled_weight;
+  double old_weight;
+};
 
 
 
@@ -56,18 +147,52 @@ public:
   void Fullfill(Ipv4Address nextHop, Ipv4Address src, Ipv4Address dst, 
                 Ptr<Packet const> packet);
   
-  void GetExpectingNbs(std::set<Ipv4Address>& nbs);
+  bool IsExpecting(Ipv4Address nb) const;
   
   double GetFullfillmentRate(Ipv4Address nb);
   double GetNumberOfData(Ipv4Address nb);
   
+  // Changes, whenever an outcome of nb is decided or becomes old.
+  // Values derived from the statistic of nb can be cached until then.
+  uint64_t GetVersion(Ipv4Address nb) const;
+  
+  // Identifies a packet without touching its bytes. It is derived from
+  // the packet uid, which survives the copies made by the channel,
+  // so the forwarded and the overheard packet have the same fingerprint.
+  static uint32_t Fingerprint(Ptr<Packet const> packet);
+  
+  // Only packets with a sample value below the sampling rate of the
+  // next hop are watched. The value is derived from the fingerprint,
+  // so every node decides the same for the same packet.
+  static double SampleValue(uint32_t fingerprint);
+  
+  // If adaptive, a neighbor whose fullfillment rate drops below 
+  // threshold is watched completely, until it recovers
+  void SetSampling(double rate, bool adaptive, double threshold);
+  
+  // Called with the neighbor, whenever its version changes
+  void SetChangeCallback(Callback<void, Ipv4Address> cb);
+  
 private:
   
-  uint8_t buffer[STAT_MAX_PKT_SIZE];
+  // Removes the front entry of the queue and its index entry
+  void PopExpect(nb_expect_t& nb);
+  
+  // Moves the timed out expectations from the front of the queue into 
+  // the outcomes, so that they stay in the order of inclusion
+  void DecideExpect(Ipv4Address nb, nb_expect_t& ex);
+  
+  // Bumps the version of nb and calls the change callback
+  void Changed(Ipv4Address nb);
   
   ExpectList expecting;
-  std::map<Ipv4Address, PacketList> fullfilled;
-  std::map<Ipv4Address, PacketList> unfullfilled;
+  std::map<Ipv4Address, OutcomeWindow> outcomes;
+  std::map<Ipv4Address, uint64_t> version;
+  Callback<void, Ipv4Address> change_cb;
+  
+  double sampling = 1;
+  bool adaptive_sampling = false;
+  double adaptive_threshold = 0.9;
   
   Time expect_timeout = Seconds(1);
   Time consider_old = Seconds(30);
@@ -30,6 +30,7 @@ namespace ahn {
 RoutingProtocol::RoutingProtocol ():
   hello_timer(Timer::CANCEL_ON_DESTROY),
   pr_ant_timer(Timer::CANCEL_ON_DESTROY),
+  rtable_timer(Timer::CANCEL_ON_DESTROY),
   
   last_hello(Seconds(0)),
   
@@ -41,6 +42,11 @@ RoutingProtocol::RoutingProtocol ():
       this->sockets[i] = 0;
     }
     
+    this->rtable.SetNeighborExpireCallback(
+      MakeCallback(&RoutingProtocol::NBExpire, this));
+    this->data_cache.SetDropCallback(
+      MakeCallback(&RoutingProtocol::DataCacheDrop, this));
+    
   }
   
 RoutingProtocol::~RoutingProtocol() {}
@@ -104,6 +110,18 @@ void RoutingProtocol::DoInitialize() {
 void RoutingProtocol::DoDispose() {
     NS_LOG_FUNCTION(this);
     
+    for (auto it = this->dcache_drain.begin(); 
+      it != this->dcache_drain.end(); ++it) {
+      it->second.Cancel();
+    }
+    this->dcache_drain.clear();
+    
+    for (auto it = this->discoveries.begin(); 
+      it != this->discoveries.end(); ++it) {
+      it->second.retry_event.Cancel();
+    }
+    this->discoveries.clear();
+    
     
     for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::iterator
       it = this->socket_addresses.begin();
@@ -144,6 +162,28 @@ Ptr<Ipv4Route> RoutingProtocol::RouteOutput (Ptr<Packet> p,
   p->PeekHeader(h);
   if (h.GetSourcePort() != this->config->ant_port) {
     this->rtable.RegisterSession(dst);
+    
+    // Data to a destination, that is being discovered, is cached.
+    // The route might have been learned without a backward ant,
+    // then the cached data goes out first.
+    if (this->IsDiscoveryPending(dst)) {
+      Ipv4Address nb;
+      if (!this->rtable.SelectRoute(dst, this->config->cons_beta,
+        nb, this->uniform_random, false)) {
+        sockerr = Socket::ERROR_NOTERROR;
+        NS_LOG_FUNCTION(this << "discovery to" << dst << "pending");
+        return this->LoopbackRoute(header, oif);
+      }
+      
+      this->EndDiscovery(dst);
+      this->SendCachedData(dst);
+    }
+    
+    // Stay behind the cached data, while it is paced out
+    if (this->IsDraining(dst)) {
+      sockerr = Socket::ERROR_NOTERROR;
+      return this->LoopbackRoute(header, oif);
+    }
   }
   
   NS_LOG_FUNCTION(this << "dst" << dst);
@@ -177,7 +217,7 @@ Ptr<Ipv4Route> RoutingProtocol::RouteOutput (Ptr<Packet> p,
   }
   
   // If not found, send it to loopback to handle it in the packet cache.
-  this->StartForwardAnt(dst, false);
+  this->StartDiscovery(dst);
   
   sockerr = Socket::ERROR_NOTERROR;
   NS_LOG_FUNCTION(this << "started FWAnt to " << dst);
@@ -251,8 +291,27 @@ bool RoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
   uint32_t iface = 1;
   Ipv4Address nb;
   
+  // Data of this node waits in the cache for a pending discovery,
+  // and behind cached data that is paced out
+  bool is_local = (origin == Ipv4Address("127.0.0.1") || origin == this_node);
+  bool must_cache = false;
+  
+  if (is_local && this->IsDiscoveryPending(dst)) {
+    if (this->rtable.SelectRoute(dst, this->config->cons_beta, 
+      nb, this->uniform_random, false)) {
+      this->EndDiscovery(dst);
+      this->SendCachedData(dst);
+    }
+    else {
+      must_cache = true;
+    }
+  }
+  if (is_local && this->IsDraining(dst)) {
+    must_cache = true;
+  }
+  
   //Search for a route, 
-  if (this->rtable.SelectRoute(dst, this->config->cons_beta, 
+  if (!must_cache && this->rtable.SelectRoute(dst, this->config->cons_beta, 
     nb, this->uniform_random, false)) {
     Ptr<Ipv4Route> rt = Create<Ipv4Route> ();
     // If a route was found:
@@ -280,7 +339,7 @@ bool RoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
     // ------------------------------------
     
   }
-  else if (origin == Ipv4Address("127.0.0.1") || origin == this_node){
+  else if (is_local) {
     // Cache, if this comes from this node
     
     // If there is no route, cache the data to wait for a route
@@ -293,7 +352,10 @@ bool RoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
     ce.ecb = ecb;
     
     NS_LOG_FUNCTION(this << "cached data, send FWAnt");
-    this->data_cache.CachePacket(dst, ce);
+    this->data_cache.CachePacket(dst, std::move(ce));
+    if (!this->IsDraining(dst)) {
+      this->StartDiscovery(dst);
+    }
     
     return true;
   }
@@ -386,17 +448,26 @@ Ptr<Ipv4Route> RoutingProtocol::LoopbackRoute(const Ipv4Header& hdr,
 // This stuff is needed for handling link layer failures
 void RoutingProtocol::AddArpCache(Ptr<ArpCache> a) {
   this->arp_cache.push_back (a);
+  this->mac_cache.clear();
 }
 
 void RoutingProtocol::DelArpCache(Ptr<ArpCache> a) {
   this->arp_cache.erase (std::remove (arp_cache.begin(), 
                                       arp_cache.end() , a), 
                                       arp_cache.end() );
+  this->mac_cache.clear();
 }
 
-std::vector<Ipv4Address> RoutingProtocol::LookupMacAddress(Mac48Address addr) {
+const std::vector<Ipv4Address>& RoutingProtocol::LookupMacAddress(Mac48Address addr) {
+  
+  mac_cache_entry_t& cached = this->mac_cache[addr];
+  if (cached.expire > Simulator::Now())
+    return cached.addresses;
   
-  std::vector<Ipv4Address> ret;
+  cached.expire = Simulator::Now() + this->config->mac_cache_expire;
+  cached.from_arp = true;
+  std::vector<Ipv4Address>& ret = cached.addresses;
+  ret.clear();
   
   // Iterate over all interfaces arp cache
   for (std::vector<Ptr<ArpCache> >::const_iterator i = this->arp_cache.begin ();
@@ -422,6 +493,37 @@ std::vector<Ipv4Address> RoutingProtocol::LookupMacAddress(Mac48Address addr) {
   return ret;
 }
 
+void RoutingProtocol::LearnMacAddress(Mac48Address mac, Ipv4Address addr) {
+  
+  mac_cache_entry_t& cached = this->mac_cache[mac];
+  if (cached.expire <= Simulator::Now()) {
+    cached.addresses.clear();
+    cached.expire = Simulator::Now() + this->config->mac_cache_expire;
+    cached.from_arp = false;
+  }
+  else if (cached.from_arp) {
+    return;
+  }
+  
+  if (std::find(cached.addresses.begin(), cached.addresses.end(), addr) 
+    == cached.addresses.end()) {
+    cached.addresses.push_back(addr);
+  }
+}
+
+void RoutingProtocol::PruneMacCache() {
+  
+  Time now = Simulator::Now();
+  for (auto it = this->mac_cache.begin(); it != this->mac_cache.end();) {
+    if (it->second.expire <= now) {
+      it = this->mac_cache.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
 // Add an interface to an operational AntHocNet instance
 void RoutingProtocol::NotifyInterfaceUp (uint32_t interface) {
   
@@ -702,6 +804,10 @@ void RoutingProtocol::Start() {
   this->pr_ant_timer.SetFunction(&RoutingProtocol::PrAntTimerExpire, this);
   this->pr_ant_timer.Schedule(this->config->pr_ant_interval);
   
+  // Start the routing table housekeeping
+  this->rtable_timer.SetFunction(&RoutingProtocol::RTableTimerExpire, this);
+  this->rtable_timer.Schedule(this->config->rtable_update_interval);
+  
   // Open socket on the loopback
   Ptr<Socket> socket = Socket::CreateSocket(GetObject<Node>(),
       UdpSocketFactory::GetTypeId());
@@ -757,7 +863,8 @@ uint32_t RoutingProtocol::FindSocketIndex(Ptr<Socket> s) const{
 }
 
 
-void RoutingProtocol::StartForwardAnt(Ipv4Address dst, bool is_proactive) {
+void RoutingProtocol::StartForwardAnt(Ipv4Address dst, bool is_proactive,
+                                      uint8_t ttl) {
   
   uint32_t iface = 1;
   Ipv4Address nb;
@@ -766,7 +873,7 @@ void RoutingProtocol::StartForwardAnt(Ipv4Address dst, bool is_proactive) {
     if (!this->rtable.SelectRoute(dst, this->config->prog_beta,
       nb, this->uniform_random,
       true)) {
-      this->BroadcastForwardAnt(dst, true);
+      this->BroadcastForwardAnt(dst, true, ttl);
       return;
     }
   }
@@ -774,7 +881,7 @@ void RoutingProtocol::StartForwardAnt(Ipv4Address dst, bool is_proactive) {
     if (!this->rtable.SelectRoute(dst, this->config->cons_beta,
       nb, this->uniform_random,
       false)) {
-      this->BroadcastForwardAnt(dst, false);
+      this->BroadcastForwardAnt(dst, false, ttl);
       return;
     }
   }
@@ -784,7 +891,7 @@ void RoutingProtocol::StartForwardAnt(Ipv4Address dst, bool is_proactive) {
     = this->socket_addresses.find(socket);
   
   Ipv4Address this_node = it->second.GetLocal();
-  ForwardAntHeader ant (this_node, dst, this->config->initial_ttl);
+  ForwardAntHeader ant (this_node, dst, ttl);
   ant.SetSeqno(this->rtable.NextSeqno());
   this->rtable.AddHistory(this_node, ant.GetSeqno());
   
@@ -799,6 +906,100 @@ void RoutingProtocol::StartForwardAnt(Ipv4Address dst, bool is_proactive) {
 }
 
 
+void RoutingProtocol::StartDiscovery(Ipv4Address dst) {
+  
+  if (this->IsDiscoveryPending(dst))
+    return;
+  
+  pending_discovery_t& disc = this->discoveries[dst];
+  disc.retries = 0;
+  disc.backoff = this->config->discovery_backoff;
+  disc.started = Simulator::Now();
+  
+  // The expanding ring search starts close to this node
+  disc.ttl = this->config->initial_ttl;
+  if (this->config->expanding_ring) {
+    disc.ttl = std::min(this->config->ttl_start, this->config->initial_ttl);
+  }
+  
+  NS_LOG_FUNCTION(this << "dst" << dst << "ttl" << (uint32_t) disc.ttl);
+  this->StartForwardAnt(dst, false, disc.ttl);
+  
+  disc.retry_event = Simulator::Schedule(disc.backoff, 
+    &RoutingProtocol::DiscoveryRetry, this, dst);
+}
+
+bool RoutingProtocol::IsDiscoveryPending(Ipv4Address dst) const {
+  return this->discoveries.find(dst) != this->discoveries.end();
+}
+
+void RoutingProtocol::DiscoveryRetry(Ipv4Address dst) {
+  
+  auto disc_it = this->discoveries.find(dst);
+  if (disc_it == this->discoveries.end())
+    return;
+  
+  pending_discovery_t& disc = disc_it->second;
+  
+  // Nobody is waiting for the route anymore
+  if (!this->data_cache.HasEntries(dst)) {
+    NS_LOG_FUNCTION(this << "dst" << dst << "no cached data, discovery ended");
+    this->discoveries.erase(disc_it);
+    return;
+  }
+  
+  // The route might have been learned without a backward ant
+  Ipv4Address nb;
+  if (this->rtable.SelectRoute(dst, this->config->cons_beta,
+    nb, this->uniform_random, false)) {
+    this->discoveries.erase(disc_it);
+    this->SendCachedData(dst);
+    return;
+  }
+  
+  if (disc.ttl < this->config->initial_ttl) {
+    // Expand the ring. Small rings are answered quickly, 
+    // so this neither counts as a retry nor increases the backoff.
+    uint32_t ttl = disc.ttl + this->config->ttl_increment;
+    if (ttl > this->config->ttl_threshold || ttl > this->config->initial_ttl) {
+      ttl = this->config->initial_ttl;
+    }
+    disc.ttl = ttl;
+  }
+  else {
+    if (disc.retries >= this->config->discovery_max_retries) {
+      NS_LOG_FUNCTION(this << "dst" << dst << "discovery failed after" 
+        << (Simulator::Now() - disc.started).GetSeconds() << "s");
+      this->discoveries.erase(disc_it);
+      this->data_cache.DropCache(dst, "Route discovery failed");
+      return;
+    }
+    
+    disc.retries++;
+    disc.backoff = std::min(disc.backoff + disc.backoff, 
+                            this->config->discovery_max_backoff);
+  }
+  
+  NS_LOG_FUNCTION(this << "dst" << dst << "retry" << disc.retries 
+    << "ttl" << (uint32_t) disc.ttl << "next in" << disc.backoff.GetSeconds());
+  this->StartForwardAnt(dst, false, disc.ttl);
+  
+  disc.retry_event = Simulator::Schedule(disc.backoff, 
+    &RoutingProtocol::DiscoveryRetry, this, dst);
+}
+
+void RoutingProtocol::EndDiscovery(Ipv4Address dst) {
+  
+  auto disc_it = this->discoveries.find(dst);
+  if (disc_it == this->discoveries.end())
+    return;
+  
+  NS_LOG_FUNCTION(this << "dst" << dst << "found after" 
+    << (Simulator::Now() - disc_it->second.started).GetSeconds() << "s");
+  disc_it->second.retry_event.Cancel();
+  this->discoveries.erase(disc_it);
+}
+
 void RoutingProtocol::UnicastForwardAnt(uint32_t iface, 
                                         Ipv4Address dst,
                                         ForwardAntHeader ant, 
@@ -871,7 +1072,8 @@ void RoutingProtocol::UnicastBackwardAnt(uint32_t iface,
   
 }
 
-void RoutingProtocol::BroadcastForwardAnt(Ipv4Address dst, bool is_proactive) {
+void RoutingProtocol::BroadcastForwardAnt(Ipv4Address dst, bool is_proactive,
+                                          uint8_t ttl) {
   
   
   for (auto sock_it = this->socket_addresses.begin();
@@ -887,7 +1089,7 @@ void RoutingProtocol::BroadcastForwardAnt(Ipv4Address dst, bool is_proactive) {
     
     Ipv4Address this_node = iface.GetLocal();
     
-    ForwardAntHeader ant (this_node, dst, this->config->initial_ttl);
+    ForwardAntHeader ant (this_node, dst, ttl);
     ant.SetSeqno(this->rtable.NextSeqno());
     this->rtable.AddHistory(this_node, ant.GetSeqno());
     
@@ -992,6 +1194,70 @@ void RoutingProtocol::ProcessTxError(WifiMacHeader const& header) {
 }
 
   
+bool RoutingProtocol::ParseSniffedFrame(Ptr<Packet const> packet, 
+                                        sniffed_frame_t& frame) {
+  
+  uint8_t buf[SNIFF_PARSE_SIZE];
+  uint32_t len = packet->CopyData(buf, SNIFF_PARSE_SIZE);
+  
+  // Frame control is little endian, only plain data frames are of interest
+  if (len < 24)
+    return false;
+  uint8_t type = (buf[0] >> 2) & 0x03;
+  uint8_t subtype = (buf[0] >> 4) & 0x0F;
+  if (type != 2 || subtype != 0)
+    return false;
+  
+  bool to_ds = buf[1] & 0x01;
+  bool from_ds = buf[1] & 0x02;
+  
+  frame.addr[0].CopyFrom(buf + 4);
+  frame.addr[1].CopyFrom(buf + 10);
+  frame.addr[2].CopyFrom(buf + 16);
+  frame.n_addr = 3;
+  
+  uint32_t pos = 24;
+  if (to_ds && from_ds) {
+    if (len < 30)
+      return false;
+    frame.addr[3].CopyFrom(buf + 24);
+    frame.n_addr = 4;
+    pos = 30;
+  }
+  
+  frame.is_ipv4 = false;
+  frame.is_udp = false;
+  
+  // LLC/SNAP header, the ethertype of IPv4 is 0x0800
+  if (len < pos + 8 + 20)
+    return true;
+  if (buf[pos] != 0xAA || buf[pos + 1] != 0xAA || buf[pos + 2] != 0x03)
+    return true;
+  if (buf[pos + 6] != 0x08 || buf[pos + 7] != 0x00)
+    return true;
+  pos += 8;
+  
+  // IPv4 header
+  uint8_t* ip = buf + pos;
+  if ((ip[0] >> 4) != 4)
+    return true;
+  
+  frame.is_ipv4 = true;
+  frame.src.Set(((uint32_t) ip[12] << 24) | ((uint32_t) ip[13] << 16) 
+    | ((uint32_t) ip[14] << 8) | ip[15]);
+  frame.dst.Set(((uint32_t) ip[16] << 24) | ((uint32_t) ip[17] << 16) 
+    | ((uint32_t) ip[18] << 8) | ip[19]);
+  
+  // UDP source port
+  uint32_t ihl = (ip[0] & 0x0F) * 4;
+  if (ip[9] == 17 && len >= pos + ihl + 2) {
+    frame.is_udp = true;
+    frame.src_port = (ip[ihl] << 8) | ip[ihl + 1];
+  }
+  
+  return true;
+}
+  
 void RoutingProtocol::ProcessMonitorSnifferRx(Ptr<Packet const> packet, 
                               uint16_t frequency, uint16_t channel, 
                               uint32_t rate, WifiPreamble isShortPreable,
@@ -1001,10 +1267,8 @@ void RoutingProtocol::ProcessMonitorSnifferRx(Ptr<Packet const> packet,
   if (!this->config->snr_cost_metric)
     return;
   
-  WifiMacHeader mac;
-  packet->PeekHeader(mac);
-  
-  if (mac.GetType() != WIFI_MAC_DATA) 
+  sniffed_frame_t frame;
+  if (!RoutingProtocol::ParseSniffedFrame(packet, frame))
     return;
   
   double last_snr = snr.signal - snr.noise;
@@ -1012,22 +1276,23 @@ void RoutingProtocol::ProcessMonitorSnifferRx(Ptr<Packet const> packet,
   //Ptr<Ipv4L3Protocol> l3 = this->ipv4->GetObject<Ipv4L3Protocol>();
   //Ipv4Address this_node = l3->GetAddress(1, 0).GetLocal();
   
-  Mac48Address addr[4];
-  addr[0] = mac.GetAddr1();
-  addr[1] = mac.GetAddr2();
-  addr[2] = mac.GetAddr3();
-  addr[3] = mac.GetAddr4();
+  // Ants are sent from the address of the transmitting node itself
+  if (frame.is_ipv4 && frame.is_udp && frame.src_port == this->config->ant_port)
+    this->LearnMacAddress(frame.addr[1], frame.src);
   
-  std::set<Ipv4Address> seen_address;
+  // Every neighbor is updated only once, even if it appears in
+  // more than one address field
+  this->sniff_seen.clear();
   
-  for (uint32_t i = 0; i < 4; i++) {
+  for (uint32_t i = 0; i < frame.n_addr; i++) {
     
-    std::vector<Ipv4Address> addresses = this->LookupMacAddress(addr[i]);
+    const std::vector<Ipv4Address>& addresses = this->LookupMacAddress(frame.addr[i]);
     
     for (std::vector<Ipv4Address>::const_iterator ad_it = addresses.begin();
       ad_it != addresses.end(); ++ad_it) {
       
-      if (seen_address.find(*ad_it) != seen_address.end())
+      if (std::find(this->sniff_seen.begin(), this->sniff_seen.end(), *ad_it) 
+        != this->sniff_seen.end())
         continue;
       
       //NS_LOG_FUNCTION(Simulator::Now().GetSeconds()
@@ -1036,12 +1301,10 @@ void RoutingProtocol::ProcessMonitorSnifferRx(Ptr<Packet const> packet,
       
       if (!this->rtable.IsNeighbor(*ad_it)) {
         this->rtable.AddNeighbor(*ad_it);
-        this->rtable.InitNeighborTimer(*ad_it, &RoutingProtocol::NBExpire, 
-                                     this);
       }
       
       this->rtable.SetLastSnr(*ad_it, last_snr);
-      seen_address.insert(*ad_it);
+      this->sniff_seen.push_back(*ad_it);
       
     }
   }
@@ -1052,67 +1315,24 @@ void RoutingProtocol::ProcessMonitorSnifferRx(Ptr<Packet const> packet,
   if (!this->config->fuzzy_mode)
     return;
   
-  WifiMacHeader mac1;
-  LlcSnapHeader snap;
-  Ipv4Header ipheader;
-  UdpHeader udpheader;
-  WifiMacTrailer trailer;
-  
-  bool has_udp_header = false;
-  bool has_ip_header = false;
-  bool has_mac_trailer = false;
-  
-  PacketMetadata::ItemIterator i = packet->BeginItem();
-  while (i.HasNext()) {
-    PacketMetadata::Item item = i.Next ();
-    
-    if (!item.isFragment && item.type == PacketMetadata::Item::HEADER) {
-      if (item.tid == ipheader.GetTypeId())
-        has_ip_header = true;
-      if (item.tid == udpheader.GetTypeId())
-        has_udp_header = true;
-    }
-    if (!item.isFragment && item.type == PacketMetadata::Item::TRAILER) {
-      if (item.tid == trailer.GetTypeId())
-        has_mac_trailer = true;
-    }
-  }
-  
   // If it has no ip header, it cannot be traffic
-  if (!has_ip_header)
+  if (!frame.is_ipv4)
+    return;
+  
+  // Ants are not watched
+  if (frame.is_udp && frame.src_port == this->config->ant_port)
     return;
   
-  std::set<Ipv4Address> expecting;
-  this->rtable.stat.GetExpectingNbs(expecting);
-  packet->PeekHeader(mac1);
-  std::vector<Ipv4Address> addresses = this->LookupMacAddress(mac1.GetAddr2());
+  // The fingerprint only depends on the packet uid, so the sniffed
+  // packet can be passed as is
+  const std::vector<Ipv4Address>& addresses = this->LookupMacAddress(frame.addr[1]);
   
   for (auto it = addresses.begin(); it != addresses.end(); ++it) {
-    if (expecting.find(*it) == expecting.end())
+    if (!this->rtable.stat.IsExpecting(*it))
       continue;
     
-    Ptr<Packet> pkt = packet->Copy();
-    pkt->RemoveHeader(mac1);
-    pkt->RemoveHeader(snap);
-    pkt->RemoveHeader(ipheader);
-    
-    if (has_udp_header) {
-      pkt->PeekHeader(udpheader);
-      if (udpheader.GetSourcePort() == this->config->ant_port) {
-        // NOTE: Return instead of continue, since it is about the packet and not the addresses.
-        return;
-      }
-    }
-    
-    if (has_mac_trailer) {
-      pkt->RemoveTrailer(trailer);
-    }
-    
-    Ipv4Address src = ipheader.GetSource();
-    Ipv4Address dst = ipheader.GetDestination();
-    
-    NS_LOG_FUNCTION("Fullfilled" << *it << src << dst << *pkt);
-    this->rtable.stat.Fullfill(*it, src, dst, pkt);
+    NS_LOG_FUNCTION("Fullfilled" << *it << frame.src << frame.dst);
+    this->rtable.stat.Fullfill(*it, frame.src, frame.dst, packet);
   }
   
   
@@ -1179,13 +1399,21 @@ void RoutingProtocol::PrAntTimerExpire() {
   std::list<Ipv4Address> dests = this->rtable.GetSessions();
   for (auto dst_it = dests.begin(); dst_it != dests.end(); ++dst_it) {
     NS_LOG_FUNCTION(this << "sampling" << *dst_it);
-    this->StartForwardAnt(*dst_it, true);
+    this->StartForwardAnt(*dst_it, true, this->config->initial_ttl);
   }
   
   Time jitter = MilliSeconds (uniform_random->GetInteger (0, 30));
   this->pr_ant_timer.Schedule(this->config->pr_ant_interval + jitter);
 }
 
+void RoutingProtocol::RTableTimerExpire() {
+  
+  this->rtable.Housekeeping(this->config->rtable_update_slice);
+  this->PruneMacCache();
+  
+  this->rtable_timer.Schedule(this->config->rtable_update_interval);
+}
+
 void RoutingProtocol::NBExpire(Ipv4Address nb) {
   NS_LOG_FUNCTION(this << "nb" << nb << "timed out");
   
@@ -1258,8 +1486,6 @@ void RoutingProtocol::Recv(Ptr<Socket> socket) {
     
     if (!this->rtable.IsNeighbor(src)) {
       this->rtable.AddNeighbor(src);
-      this->rtable.InitNeighborTimer(src, &RoutingProtocol::NBExpire, 
-                                     this);
     }
     this->rtable.UpdateNeighbor(src);
     
@@ -1345,8 +1571,6 @@ void RoutingProtocol::HandleHelloMsg(Ptr<Packet> packet, uint32_t iface) {
   
   if (!this->rtable.IsNeighbor(hello_msg.GetSrc())) {
     this->rtable.AddNeighbor(hello_msg.GetSrc());
-    this->rtable.InitNeighborTimer(hello_msg.GetSrc(), 
-      &RoutingProtocol::NBExpire, this);
   }
   
   this->rtable.HandleHelloMsg(hello_msg);
@@ -1579,8 +1803,6 @@ void RoutingProtocol::HandleBackwardAnt(Ptr<Packet> packet,
   
   if (!this->rtable.IsNeighbor(nb)) {
     this->rtable.AddNeighbor(nb);
-    this->rtable.InitNeighborTimer(nb, &RoutingProtocol::NBExpire, 
-                                   this);
   }
   
   
@@ -1594,6 +1816,7 @@ void RoutingProtocol::HandleBackwardAnt(Ptr<Packet> packet,
       
       if(this->rtable.ProcessBackwardAnt(src, nb, 
         ant.GetT(),(ant.GetMaxHops() - ant.GetHops()) )) {
+        this->EndDiscovery(src);
         this->SendCachedData(src);
       }
       return;
@@ -1621,66 +1844,128 @@ void RoutingProtocol::SendCachedData(Ipv4Address dst) {
   
   //NS_LOG_FUNCTION(this << "dst" << dst);
   
-  bool dst_found = false;
+  if (!this->config->dcache_pacing) {
+    Time t_send;
+    
+    // The route broke, while packets are still waiting for it
+    if (!this->SendCachedBatch(dst, 0, t_send))
+      this->StartDiscovery(dst);
+    return;
+  }
+  
+  // If the destination is already draining, the next batch 
+  // will use the new route anyway
+  if (this->IsDraining(dst)) {
+    return;
+  }
+  
+  this->DrainCachedData(dst);
+}
+
+bool RoutingProtocol::IsDraining(Ipv4Address dst) const {
+  
+  auto drain_it = this->dcache_drain.find(dst);
+  return drain_it != this->dcache_drain.end() && drain_it->second.IsRunning();
+}
+
+void RoutingProtocol::DrainCachedData(Ipv4Address dst) {
+  
+  Time t_send = Seconds(0);
+  
+  if (!this->SendCachedBatch(dst, this->config->dcache_batch_size, t_send)) {
+    // The route broke during the drain, find a new one
+    // for the remaining packets
+    this->dcache_drain.erase(dst);
+    this->StartDiscovery(dst);
+    return;
+  }
+  
+  if (!this->data_cache.HasEntries(dst)) {
+    this->dcache_drain.erase(dst);
+    return;
+  }
+  
+  // Give the mac layer the time it needs for this batch, 
+  // before the next one is released
+  Time gap = std::min(std::max(t_send, this->config->dcache_pacing_min),
+                      this->config->dcache_pacing_max);
+  
+  NS_LOG_FUNCTION(this << "dst" << dst << "next batch in" << gap.GetMicroSeconds());
+  this->dcache_drain[dst] = 
+    Simulator::Schedule(gap, &RoutingProtocol::DrainCachedData, this, dst);
+}
+
+bool RoutingProtocol::SendCachedBatch(Ipv4Address dst, uint32_t max_packets,
+                                      Time& t_send) {
   
-  while (this->data_cache.HasEntries(dst)) {
+  uint32_t sent = 0;
+  
+  while (this->data_cache.HasEntries(dst) 
+    && (max_packets == 0 || sent < max_packets)) {
+    
+    uint32_t iface = 1;
+    Ipv4Address nb;
+    
+    // Look up the route first, such that the packets stay 
+    // cached, if there is none
+    if (!this->rtable.SelectRoute(dst, this->config->cons_beta,
+      nb, this->uniform_random, false)) {
+      NS_LOG_FUNCTION(this << "no route to" << dst << "keep cached data");
+      return false;
+    }
+    
     std::pair<bool, CacheEntry> cv = this->data_cache.GetCacheEntry(dst);
     
-    // check, if cache entry is expired
+    // check, if cache entry is expired. Usually the expiry timer
+    // of the cache has dropped it already.
     if (cv.first == false) {
-      NS_LOG_FUNCTION(this << "Data " << cv.second.packet << "expired");
-      this->data_drop(cv.second.packet, 
-                      "Cached and expired", cv.second.header.GetSource());
+      this->DataCacheDrop(cv.second, "Cached and expired");
       continue;
     }
     
-    uint32_t iface = 1;
-    Ipv4Address nb;
-    
     Ptr<Ipv4L3Protocol> l3 = this->ipv4->GetObject<Ipv4L3Protocol>();
     Ipv4Address this_node = l3->GetAddress(iface, 0).GetLocal();
     
-    if (this->rtable.SelectRoute(dst, this->config->cons_beta,
-      nb, this->uniform_random, false)) {
-      Ptr<Ipv4Route> rt = Create<Ipv4Route> ();
-      
-      // Create the route and call UnicastForwardCallback
-      if (cv.second.header.GetSource() != Ipv4Address("127.0.0.1")) {
-        rt->SetSource(cv.second.header.GetSource());
-      } else {
-        rt->SetSource(this_node);
-      }
+    Ptr<Ipv4Route> rt = Create<Ipv4Route> ();
     
-      rt->SetDestination(dst);
-      rt->SetOutputDevice(this->ipv4->GetNetDevice(iface));
-      rt->SetGateway(nb);
-      
-      NS_LOG_FUNCTION(this << "route to" << *rt
-        << "Data " << cv.second.packet << "send");
-      cv.second.ucb(rt, cv.second.packet, cv.second.header);
-      
-      // -------------------------------- 
-      // Fuzzy logic 
-      if (this->config->fuzzy_mode) {
-        NS_LOG_FUNCTION("Expect" << nb << cv.second.header.GetSource() << dst << *cv.second.packet);
-        this->rtable.stat.Expect(nb, cv.second.header.GetSource(), dst, cv.second.packet);
-      }
-      // --------------------------------------------
-      
-      
-      // If there was a route found, the destination must exist
-      // in rtable. We can safely assume, that all data to that destination
-      // will get routed out here
-      dst_found = true;
+    // Create the route and call UnicastForwardCallback
+    if (cv.second.header.GetSource() != Ipv4Address("127.0.0.1")) {
+      rt->SetSource(cv.second.header.GetSource());
+    } else {
+      rt->SetSource(this_node);
     }
-  
+    
+    rt->SetDestination(dst);
+    rt->SetOutputDevice(this->ipv4->GetNetDevice(iface));
+    rt->SetGateway(nb);
+    
+    NS_LOG_FUNCTION(this << "route to" << *rt
+      << "Data " << cv.second.packet << "send");
+    cv.second.ucb(rt, cv.second.packet, cv.second.header);
+    
+    // -------------------------------- 
+    // Fuzzy logic 
+    if (this->config->fuzzy_mode) {
+      NS_LOG_FUNCTION("Expect" << nb << cv.second.header.GetSource() << dst << *cv.second.packet);
+      this->rtable.stat.Expect(nb, cv.second.header.GetSource(), dst, cv.second.packet);
+    }
+    // --------------------------------------------
+    
+    t_send += this->rtable.GetTSend(nb);
+    sent++;
   }
   
-  // If this destination exists, all the data 
-  // is routed out by now and can be discarded
-  if (dst_found) {
-      this->data_cache.RemoveCache(dst);
-  }
+  return true;
+}
+
+void RoutingProtocol::DataCacheDrop(CacheEntry ce, std::string reason) {
+  
+  NS_LOG_FUNCTION(this << "Data " << ce.packet << reason);
+  this->data_drop(ce.packet, reason, ce.header.GetSource());
+  
+  Socket::SocketErrno sockerr = Socket::ERROR_NOROUTETOHOST;
+  if (!ce.ecb.IsNull())
+    ce.ecb(ce.packet, ce.header, sockerr);
 }
 
 // End of namespaces
@@ -24,6 +24,7 @@
 #include "anthocnet-pcache.h"
 
 #include <list>
+#include <unordered_map>
 
 #include "ns3/node.h"
 #include "ns3/random-variable-stream.h"
@@ -55,8 +56,67 @@
 
 #define MAX_INTERFACES 30
 
+// Enough bytes of a sniffed frame to hold the wifi mac header with
+// four addresses, LLC/SNAP, an IPv4 header with options and the udp ports
+#define SNIFF_PARSE_SIZE 128
+
+// Drives the data cache of a protocol instance directly
+class AnthocnetCachePacingTestCase;
+// Learns and looks up mac addresses directly
+class AnthocnetMacCacheTestCase;
+
 namespace ns3 {
 namespace ahn {
+
+// The fields of a sniffed data frame, that are used by the 
+// snr metric and the traffic analysis
+typedef struct SniffedFrame {
+  Mac48Address addr[4];
+  uint32_t n_addr;
+  
+  bool is_ipv4;
+  Ipv4Address src;
+  Ipv4Address dst;
+  
+  bool is_udp;
+  uint16_t src_port;
+} sniffed_frame_t;
+
+// Result of resolving a mac address to the IPv4 addresses of a node
+typedef struct MacCacheEntry {
+  std::vector<Ipv4Address> addresses;
+  Time expire;
+  // The addresses came from the arp caches, not from overheard frames
+  bool from_arp;
+} mac_cache_entry_t;
+
+// A reactive route discovery, which is waiting for a backward ant.
+// Data to the destination is cached meanwhile.
+typedef struct PendingDiscovery {
+  PendingDiscovery() : retries(0), ttl(0) {}
+  
+  // Forward ant generations sent after the first one,
+  // which had the full TTL
+  uint32_t retries;
+  // TTL of the last generation, see ExpandingRing
+  uint8_t ttl;
+  Time backoff;
+  Time started;
+  EventId retry_event;
+} pending_discovery_t;
+
+struct Mac48AddressHash {
+  size_t operator()(const Mac48Address& addr) const {
+    uint8_t buf[6];
+    addr.CopyTo(buf);
+    
+    // The last bytes differ the most between nodes
+    uint64_t h = 0;
+    for (uint32_t i = 0; i < 6; i++)
+      h = (h << 8) | buf[i];
+    return (size_t) (h * 0x9E3779B97F4A7C15ULL >> 16);
+  }
+};
   
 class RoutingProtocol : public Ipv4RoutingProtocol {
 public:
@@ -91,10 +151,16 @@ public:
   void SetConfig(Ptr<AntHocNetConfig> config);
   Ptr<AntHocNetConfig> GetConfig() const;
   
+  // Reads the fields of a sniffed frame directly from its bytes.
+  // Returns false, if it is not a data frame.
+  static bool ParseSniffedFrame(Ptr<Packet const> packet, sniffed_frame_t& frame);
+  
 protected:
     virtual void DoInitialize();
   
 private:
+  friend class ::AnthocnetCachePacingTestCase;
+  friend class ::AnthocnetMacCacheTestCase;
   
   // All the utiliy and callback functions of the protocol go here
   // Sets up the operation of the protocol
@@ -111,32 +177,71 @@ private:
   TracedCallback<Ptr<Packet const>, std::string, Ipv4Address> ant_drop;
   TracedCallback<Ptr<Packet const>, std::string, Ipv4Address> data_drop;
   
-  void StartForwardAnt(Ipv4Address dst, bool is_proactive);
+  void StartForwardAnt(Ipv4Address dst, bool is_proactive, uint8_t ttl);
   
   void UnicastForwardAnt(uint32_t iface, Ipv4Address dst, ForwardAntHeader ant,
                          bool is_proactive);
   
-  void BroadcastForwardAnt(Ipv4Address dst, bool is_proactive);
+  void BroadcastForwardAnt(Ipv4Address dst, bool is_proactive, uint8_t ttl);
   void BroadcastForwardAnt(Ipv4Address dst, ForwardAntHeader ant,\
                            bool is_proactive);
   
   void UnicastBackwardAnt(uint32_t iface, Ipv4Address dst, 
                           BackwardAntHeader ant);
   
+  // Starts a route discovery to dst, unless one is pending
+  void StartDiscovery(Ipv4Address dst);
+  bool IsDiscoveryPending(Ipv4Address dst) const;
+  // Sends the next generation of forward ants or gives up
+  void DiscoveryRetry(Ipv4Address dst);
+  void EndDiscovery(Ipv4Address dst);
+  
   void SendCachedData(Ipv4Address dst);
   
+  // Sends the next batch of cached data to dst and schedules 
+  // the following one, see DataCachePacing
+  void DrainCachedData(Ipv4Address dst);
+  // True, while batches of cached data to dst are pending
+  bool IsDraining(Ipv4Address dst) const;
+  
+  // Sends up to max_packets (0 for all) cached packets to dst.
+  // t_send accumulates the average send times of the used next hops.
+  // Stops early and returns false, if there is no route.
+  bool SendCachedBatch(Ipv4Address dst, uint32_t max_packets, Time& t_send);
+  
+  // Called by the data cache for every packet it drops
+  void DataCacheDrop(CacheEntry ce, std::string reason);
+  
   // Add ARP cache to be used to allow layer 2 notifications processing
   void AddArpCache (Ptr<ArpCache>);
   // Don't use given ARP cache any more (interface is down)
   void DelArpCache (Ptr<ArpCache>);
   
   // Search all interfaces arpcaches for that mac address
-  std::vector<Ipv4Address> LookupMacAddress (Mac48Address addr);
+  // The result stays valid until the next lookup
+  const std::vector<Ipv4Address>& LookupMacAddress (Mac48Address addr);
+  
+  // Adds a pair, which was observed on the channel, to the mac cache.
+  // A live entry keeps its expiry, and entries from the arp caches
+  // are left alone, such that the arp caches are asked again in time.
+  void LearnMacAddress (Mac48Address mac, Ipv4Address addr);
+  
+  // Removes the expired entries from the mac cache
+  void PruneMacCache ();
   
   // Holds pointers to all arp caches, such that it can
   // look up IP addresses from MACs. Needed for L2 support
   std::vector<Ptr<ArpCache> > arp_cache;
   
+  // LookupMacAddress asks the arp caches only if an entry 
+  // is missing or expired. Empty results are cached as well.
+  // Expired entries are pruned with the routing table housekeeping.
+  std::unordered_map<Mac48Address, mac_cache_entry_t, Mac48AddressHash> mac_cache;
+  
+  // The neighbors already updated from the current sniffed frame.
+  // Reused between frames.
+  std::vector<Ipv4Address> sniff_seen;
+  
   // ----------------------------------------------
   // Called when there is an error in the Layer 2 link
   void ProcessTxError (WifiMacHeader const& header);
@@ -194,6 +299,7 @@ private:
   
   Timer hello_timer;
   Timer pr_ant_timer;
+  Timer rtable_timer;
   
   Ptr<UniformRandomVariable> uniform_random;
   
@@ -212,6 +318,12 @@ private:
   // The Cache for the data that has no route yet
   PacketCache data_cache;
   
+  // Pending batches of paced cached data, per destination
+  std::map<Ipv4Address, EventId> dcache_drain;
+  
+  // Route discoveries waiting for a backward ant, per destination
+  std::map<Ipv4Address, pending_discovery_t> discoveries;
+  
   // The IP protocol
   Ptr<Ipv4> ipv4;
   
@@ -1,7 +1,23 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <vector>
+
 // Include a header file from your module to test.
 #include "ns3/anthocnet.h"
+#include "ns3/anthocnet-helper.h"
+#include "ns3/simulator.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/simple-channel.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/udp-header.h"
+#include "ns3/udp-l4-protocol.h"
+#include "ns3/udp-socket-factory.h"
+#include "ns3/inet-socket-address.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
@@ -46,6 +62,1847 @@ AnthocnetTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+// Checks that the alias table reproduces the distribution it was built from
+class AnthocnetAliasTableTestCase : public TestCase
+{
+public:
+  AnthocnetAliasTableTestCase ();
+  virtual ~AnthocnetAliasTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetAliasTableTestCase::AnthocnetAliasTableTestCase ()
+  : TestCase ("Anthocnet alias table next hop sampling")
+{
+}
+
+AnthocnetAliasTableTestCase::~AnthocnetAliasTableTestCase ()
+{
+}
+
+void
+AnthocnetAliasTableTestCase::DoRun (void)
+{
+  ahn::AliasTable table;
+  NS_TEST_ASSERT_MSG_EQ (table.IsEmpty (), true, "New table is not empty");
+
+  ahn::ProbVect pv;
+  pv.push_back (std::make_pair (Ipv4Address ("10.0.0.1"), 1.0));
+  pv.push_back (std::make_pair (Ipv4Address ("10.0.0.2"), 3.0));
+  pv.push_back (std::make_pair (Ipv4Address ("10.0.0.3"), 0.0));
+  table.Build (pv);
+
+  // Sweep the unit interval evenly, the hits must follow the weights
+  uint32_t steps = 4000;
+  uint32_t hits[3] = {0, 0, 0};
+  for (uint32_t i = 0; i < steps; i++)
+    {
+      Ipv4Address nb = table.Sample ((i + 0.5) / steps);
+      for (uint32_t j = 0; j < 3; j++)
+        {
+          if (nb == pv[j].first)
+            {
+              hits[j]++;
+            }
+        }
+    }
+
+  NS_TEST_ASSERT_MSG_EQ_TOL (hits[0] / (double) steps, 0.25, 0.001, "Wrong share of first hop");
+  NS_TEST_ASSERT_MSG_EQ_TOL (hits[1] / (double) steps, 0.75, 0.001, "Wrong share of second hop");
+  NS_TEST_ASSERT_MSG_EQ (hits[2], 0, "Hop without weight was selected");
+}
+
+// Checks duplicate detection of the sliding ant history window
+class AnthocnetHistoryWindowTestCase : public TestCase
+{
+public:
+  AnthocnetHistoryWindowTestCase ();
+  virtual ~AnthocnetHistoryWindowTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetHistoryWindowTestCase::AnthocnetHistoryWindowTestCase ()
+  : TestCase ("Anthocnet ant history sliding window")
+{
+}
+
+AnthocnetHistoryWindowTestCase::~AnthocnetHistoryWindowTestCase ()
+{
+}
+
+void
+AnthocnetHistoryWindowTestCase::DoRun (void)
+{
+  ahn::AntHistWindow window;
+  window.Init (64);
+  NS_TEST_ASSERT_MSG_EQ (window.Has (0), false, "Empty window has a seqno");
+
+  window.Add (10);
+  window.Add (12);
+  NS_TEST_ASSERT_MSG_EQ (window.Has (10), true, "Seqno 10 not found");
+  NS_TEST_ASSERT_MSG_EQ (window.Has (11), false, "Seqno 11 was never added");
+  NS_TEST_ASSERT_MSG_EQ (window.Has (12), true, "Seqno 12 not found");
+  NS_TEST_ASSERT_MSG_EQ (window.Has (13), false, "Seqno 13 was never added");
+
+  // Out of order arrival inside the window
+  window.Add (11);
+  NS_TEST_ASSERT_MSG_EQ (window.Has (11), true, "Seqno 11 not found");
+
+  // Slide the window, the reused slots must be cleared
+  window.Add (12 + 64);
+  NS_TEST_ASSERT_MSG_EQ (window.Has (12 + 64), true, "Seqno 76 not found");
+  NS_TEST_ASSERT_MSG_EQ (window.Has (13 + 62), false, "Seqno 75 was never added");
+
+  // Everything older than the window counts as seen
+  NS_TEST_ASSERT_MSG_EQ (window.Has (5), true, "Old seqno not treated as seen");
+}
+
+// Checks the incremental best and second best pheromone index
+class AnthocnetBestPheromoneTestCase : public TestCase
+{
+public:
+  AnthocnetBestPheromoneTestCase ();
+  virtual ~AnthocnetBestPheromoneTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetBestPheromoneTestCase::AnthocnetBestPheromoneTestCase ()
+  : TestCase ("Anthocnet best pheromone index")
+{
+}
+
+AnthocnetBestPheromoneTestCase::~AnthocnetBestPheromoneTestCase ()
+{
+}
+
+void
+AnthocnetBestPheromoneTestCase::DoRun (void)
+{
+  ahn::BestPheromone best;
+  NS_TEST_ASSERT_MSG_EQ (best.first, NO_COLUMN, "New index has a best column");
+
+  best.Update (0, 0.2);
+  best.Update (1, 0.5);
+  best.Update (2, 0.3);
+  NS_TEST_ASSERT_MSG_EQ (best.first, 1, "Wrong best column");
+  NS_TEST_ASSERT_MSG_EQ (best.second, 2, "Wrong second best column");
+
+  // Second best overtakes the best
+  best.Update (2, 0.7);
+  NS_TEST_ASSERT_MSG_EQ (best.first, 2, "Wrong best column after increase");
+  NS_TEST_ASSERT_MSG_EQ (best.second, 1, "Wrong second column after increase");
+  NS_TEST_ASSERT_MSG_EQ (best.dirty, false, "Increase marked the index dirty");
+
+  // Decrease of the best value below the second one needs a rescan
+  best.Update (2, 0.1);
+  NS_TEST_ASSERT_MSG_EQ (best.dirty, true, "Decrease did not mark the index dirty");
+}
+
+// Checks that the pheromone evaporates by alpha per interval when it is
+// read, that the ranks order entries written at different times, and
+// when an entry decays below the minimum
+class AnthocnetEvaporationTestCase : public TestCase
+{
+public:
+  AnthocnetEvaporationTestCase ();
+  virtual ~AnthocnetEvaporationTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Advance (Time delay);
+};
+
+AnthocnetEvaporationTestCase::AnthocnetEvaporationTestCase ()
+  : TestCase ("Anthocnet pheromone evaporation")
+{
+}
+
+AnthocnetEvaporationTestCase::~AnthocnetEvaporationTestCase ()
+{
+}
+
+void
+AnthocnetEvaporationTestCase::Advance (Time delay)
+{
+  Simulator::Stop (delay);
+  Simulator::Run ();
+}
+
+void
+AnthocnetEvaporationTestCase::DoRun (void)
+{
+  Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+  config->SetAttribute ("EvaporationInterval", TimeValue (Seconds (1)));
+  double alpha = config->alpha;
+  double min = config->min_pheromone;
+
+  ahn::RoutingTable rtable;
+  rtable.SetConfig (config);
+
+  Ipv4Address dst ("10.0.0.9");
+  Ipv4Address nbA ("10.0.0.2");
+  Ipv4Address nbB ("10.0.0.3");
+  rtable.AddNeighbor (nbA);
+  rtable.AddNeighbor (nbB);
+  rtable.AddDestination (dst);
+
+  Advance (Seconds (1));
+  rtable.SetPheromone (dst, nbA, 0.8, false);
+  Advance (Seconds (1));
+  rtable.SetPheromone (dst, nbB, 0.5, false);
+
+  const ahn::RoutingTableEntry *a = rtable.FindEntry (dst, nbA);
+  const ahn::RoutingTableEntry *b = rtable.FindEntry (dst, nbB);
+  NS_TEST_ASSERT_MSG_EQ_TOL (rtable.ReadPheromone (*a, false), 0.8 * alpha, 1e-9,
+                             "Wrong pheromone after one interval");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rtable.ReadPheromone (*b, false), 0.5, 1e-9,
+                             "Fresh pheromone evaporated");
+  double rankA = rtable.PheromoneRank (*a, false);
+  double rankB = rtable.PheromoneRank (*b, false);
+  NS_TEST_ASSERT_MSG_GT (rankA, rankB, "Older, but stronger entry ranked lower");
+
+  // Fractions of an interval evaporate, too
+  Advance (Seconds (2.5));
+  NS_TEST_ASSERT_MSG_EQ_TOL (rtable.GetPheromone (dst, nbA, false), 0.8 * std::pow (alpha, 3.5), 1e-9,
+                             "Wrong pheromone after 3.5 intervals");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rtable.GetPheromone (dst, nbB, false), 0.5 * std::pow (alpha, 2.5), 1e-9,
+                             "Wrong pheromone after 2.5 intervals");
+
+  // Ranks do not move, while the entries evaporate
+  NS_TEST_ASSERT_MSG_EQ (rtable.PheromoneRank (*a, false), rankA, "Rank changed by evaporation");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rankA - rankB,
+                             std::log (rtable.ReadPheromone (*a, false) / rtable.ReadPheromone (*b, false)), 1e-9,
+                             "Ranks do not match the evaporated values");
+
+  // A fresh, smaller value overtakes the evaporated one
+  rtable.SetPheromone (dst, nbB, 0.3, false);
+  NS_TEST_ASSERT_MSG_LT (rtable.ReadPheromone (*a, false), 0.3, "Entry did not evaporate");
+  NS_TEST_ASSERT_MSG_GT (rtable.PheromoneRank (*b, false), rtable.PheromoneRank (*a, false),
+                         "Fresh entry ranked below the evaporated one");
+
+  // Decays below the minimum at 1s + log(min / 0.8) / log(alpha) intervals
+  Time decay = rtable.GetDecayTime (*a, a->pheromone);
+  NS_TEST_ASSERT_MSG_EQ_TOL (decay.GetSeconds (), 1 + std::log (min / 0.8) / std::log (alpha), 1e-6,
+                             "Wrong decay time");
+  Advance (decay - Simulator::Now () - MilliSeconds (1));
+  NS_TEST_ASSERT_MSG_GT (rtable.ReadPheromone (*a, false), min, "Decayed too early");
+  Advance (MilliSeconds (2));
+  NS_TEST_ASSERT_MSG_LT (rtable.ReadPheromone (*a, false), min, "Did not decay in time");
+  NS_TEST_ASSERT_MSG_EQ (rtable.GetDecayTime (*a, min / 2), Time::Max (),
+                         "Decay time of an entry below the minimum");
+
+  // No evaporation without an interval
+  config->SetAttribute ("EvaporationInterval", TimeValue (Seconds (0)));
+  NS_TEST_ASSERT_MSG_EQ (rtable.ReadPheromone (*b, false), 0.3, "Evaporated without an interval");
+  NS_TEST_ASSERT_MSG_EQ (rtable.GetDecayTime (*b, 0.3), Time::Max (), "Decays without an interval");
+
+  Simulator::Destroy ();
+}
+
+// Checks that removed neighbors and destinations free their slots of the
+// pheromone matrix for reuse, and that the housekeeping removes decayed
+// destinations a slice at a time
+class AnthocnetHousekeepingTestCase : public TestCase
+{
+public:
+  AnthocnetHousekeepingTestCase ();
+  virtual ~AnthocnetHousekeepingTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  // True, if the row of dst has no entries
+  bool IsRowEmpty (ahn::RoutingTable &rtable, Ipv4Address dst);
+};
+
+AnthocnetHousekeepingTestCase::AnthocnetHousekeepingTestCase ()
+  : TestCase ("Anthocnet routing table slots and housekeeping")
+{
+}
+
+AnthocnetHousekeepingTestCase::~AnthocnetHousekeepingTestCase ()
+{
+}
+
+bool
+AnthocnetHousekeepingTestCase::IsRowEmpty (ahn::RoutingTable &rtable, Ipv4Address dst)
+{
+  ahn::RoutingTableEntry *row = rtable.GetRow (rtable.dsts.find (dst)->second.index);
+  for (uint32_t i = 0; i < rtable.nb_stride; i++)
+    {
+      if (!rtable.IsEmpty (row[i]))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+void
+AnthocnetHousekeepingTestCase::DoRun (void)
+{
+  Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+  config->SetAttribute ("EvaporationInterval", TimeValue (Seconds (1)));
+
+  ahn::RoutingTable rtable;
+  rtable.SetConfig (config);
+
+  Ipv4Address nbA ("10.0.0.2");
+  Ipv4Address nbB ("10.0.0.3");
+  Ipv4Address nbC ("10.0.0.4");
+  rtable.AddNeighbor (nbA);
+  rtable.AddNeighbor (nbB);
+
+  // A neighbor is a destination as well
+  NS_TEST_ASSERT_MSG_EQ (rtable.IsDestination (nbA), true, "Neighbor is no destination");
+
+  // The odd destinations get little pheromone, which decays soon
+  std::vector<Ipv4Address> dsts;
+  for (uint32_t i = 1; i <= 6; i++)
+    {
+      std::ostringstream addr;
+      addr << "10.0.1." << i;
+      dsts.push_back (Ipv4Address (addr.str ().c_str ()));
+      rtable.AddDestination (dsts.back ());
+      rtable.SetPheromone (dsts.back (), nbA, (i % 2) ? 0.001 : 1.0, false);
+    }
+
+  // A removed neighbor leaves no entries, its column is reused
+  rtable.SetPheromone (dsts[1], nbB, 0.5, false);
+  uint32_t col = rtable.nbs.find (nbB)->second.index;
+  rtable.RemoveNeighbor (nbB);
+  NS_TEST_ASSERT_MSG_EQ (rtable.IsNeighbor (nbB), false, "Neighbor not removed");
+  rtable.AddNeighbor (nbC);
+  NS_TEST_ASSERT_MSG_EQ (rtable.nbs.find (nbC)->second.index, col, "Column not reused");
+  NS_TEST_ASSERT_MSG_EQ (rtable.GetPheromone (dsts[1], nbC, false), 0, "Reused column has old entries");
+  NS_TEST_ASSERT_MSG_EQ (rtable.nb_dsts[col].size (), 0, "Reused column lists old destinations");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rtable.GetPheromone (dsts[1], nbA, false), 1.0, 1e-9,
+                             "Entry of another neighbor lost");
+
+  // A removed destination leaves no entries, its row is reused
+  Ipv4Address extra ("10.0.2.1");
+  uint32_t row = rtable.dsts.find (dsts[5])->second.index;
+  rtable.RemoveDestination (dsts[5]);
+  NS_TEST_ASSERT_MSG_EQ (rtable.IsDestination (dsts[5]), false, "Destination not removed");
+  rtable.AddDestination (extra);
+  NS_TEST_ASSERT_MSG_EQ (rtable.dsts.find (extra)->second.index, row, "Row not reused");
+  NS_TEST_ASSERT_MSG_EQ (IsRowEmpty (rtable, extra), true, "Reused row has old entries");
+  rtable.RemoveDestination (extra);
+  rtable.AddDestination (dsts[5]);
+  rtable.SetPheromone (dsts[5], nbA, 1.0, false);
+
+  // 0.001 decays below MinPheromone in 7 intervals, 1.0 in 26
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  // Slices visit nbA, nbB, nbC | 10.0.1.1 - 10.0.1.3 | 10.0.1.4 - 10.0.1.6.
+  // The former neighbor nbB has no entries left and goes as well.
+  const uint32_t removed[] = { 1, 3, 4 };
+  const uint32_t cleared[] = { 0, 2, 3 };
+  for (uint32_t slice = 0; slice < 3; slice++)
+    {
+      rtable.Housekeeping (3);
+      const ahn::HousekeepingStats &stats = rtable.GetHousekeepingStats ();
+      NS_TEST_ASSERT_MSG_EQ (stats.dsts_visited, 3 * (slice + 1), "Slice " << slice << " visited too much");
+      NS_TEST_ASSERT_MSG_EQ (stats.dsts_removed, removed[slice], "Slice " << slice << " removed wrong destinations");
+      NS_TEST_ASSERT_MSG_EQ (stats.entries_cleared, cleared[slice], "Slice " << slice << " cleared wrong entries");
+    }
+
+  for (uint32_t i = 0; i < dsts.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (rtable.IsDestination (dsts[i]), (i % 2) == 1,
+                             "Destination " << dsts[i] << " wrongly kept or removed");
+    }
+  NS_TEST_ASSERT_MSG_EQ (rtable.IsDestination (nbA), true, "Neighbor removed as a destination");
+  NS_TEST_ASSERT_MSG_EQ (rtable.IsDestination (nbC), true, "Neighbor removed as a destination");
+  NS_TEST_ASSERT_MSG_EQ (rtable.IsDestination (nbB), false, "Unused former neighbor kept");
+
+  // The rows of the removed destinations are free again
+  NS_TEST_ASSERT_MSG_EQ (rtable.free_dst_index.size (), 4, "Rows not freed");
+  rtable.AddDestination (extra);
+  NS_TEST_ASSERT_MSG_EQ (IsRowEmpty (rtable, extra), true, "Row freed by the housekeeping has old entries");
+
+  Simulator::Destroy ();
+}
+
+// Checks that the expiry wheel reports every neighbor exactly once,
+// after NeighborExpire without an update, and that refreshed or
+// removed neighbors do not expire early
+class AnthocnetNeighborWheelTestCase : public TestCase
+{
+public:
+  AnthocnetNeighborWheelTestCase ();
+  virtual ~AnthocnetNeighborWheelTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Add (Ipv4Address nb);
+  void Update (Ipv4Address nb);
+  void Remove (Ipv4Address nb);
+  void Expired (Ipv4Address nb);
+
+  ahn::RoutingTable m_rtable;
+  std::map<Ipv4Address, std::vector<Time> > m_expired;
+};
+
+AnthocnetNeighborWheelTestCase::AnthocnetNeighborWheelTestCase ()
+  : TestCase ("Anthocnet neighbor expiry wheel")
+{
+}
+
+AnthocnetNeighborWheelTestCase::~AnthocnetNeighborWheelTestCase ()
+{
+}
+
+void
+AnthocnetNeighborWheelTestCase::Add (Ipv4Address nb)
+{
+  m_rtable.AddNeighbor (nb);
+  m_rtable.UpdateNeighbor (nb);
+}
+
+void
+AnthocnetNeighborWheelTestCase::Update (Ipv4Address nb)
+{
+  m_rtable.UpdateNeighbor (nb);
+}
+
+void
+AnthocnetNeighborWheelTestCase::Remove (Ipv4Address nb)
+{
+  m_rtable.RemoveNeighbor (nb);
+}
+
+void
+AnthocnetNeighborWheelTestCase::Expired (Ipv4Address nb)
+{
+  m_expired[nb].push_back (Simulator::Now ());
+
+  // As the protocol does on a timeout
+  m_rtable.RemoveNeighbor (nb);
+}
+
+void
+AnthocnetNeighborWheelTestCase::DoRun (void)
+{
+  Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+  config->SetAttribute ("NeighborExpire", TimeValue (Seconds (3)));
+  config->SetAttribute ("NeighborExpireGranularity", TimeValue (MilliSeconds (100)));
+  m_rtable.SetConfig (config);
+  m_rtable.SetNeighborExpireCallback (MakeCallback (&AnthocnetNeighborWheelTestCase::Expired, this));
+
+  Ipv4Address nbA ("10.0.0.2");
+  Ipv4Address nbB ("10.0.0.3");
+  Ipv4Address nbC ("10.0.0.4");
+  Ipv4Address nbD ("10.0.0.5");
+
+  // nbA is refreshed several times, nbB never
+  Simulator::Schedule (Seconds (1), &AnthocnetNeighborWheelTestCase::Add, this, nbA);
+  Simulator::Schedule (Seconds (1), &AnthocnetNeighborWheelTestCase::Add, this, nbB);
+  Simulator::Schedule (Seconds (2.5), &AnthocnetNeighborWheelTestCase::Update, this, nbA);
+  Simulator::Schedule (Seconds (3), &AnthocnetNeighborWheelTestCase::Update, this, nbA);
+  Simulator::Schedule (Seconds (3), &AnthocnetNeighborWheelTestCase::Update, this, nbA);
+
+  // nbC is removed and comes back, its first wheel entry is stale
+  Simulator::Schedule (Seconds (1), &AnthocnetNeighborWheelTestCase::Add, this, nbC);
+  Simulator::Schedule (Seconds (2), &AnthocnetNeighborWheelTestCase::Remove, this, nbC);
+  Simulator::Schedule (MilliSeconds (2200), &AnthocnetNeighborWheelTestCase::Add, this, nbC);
+
+  // nbD expires off the granularity, in the next slot
+  Simulator::Schedule (MilliSeconds (1250), &AnthocnetNeighborWheelTestCase::Add, this, nbD);
+
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_expired[nbA].size (), 1, "Refreshed neighbor not expired once");
+  NS_TEST_ASSERT_MSG_EQ (m_expired[nbB].size (), 1, "Neighbor not expired once");
+  NS_TEST_ASSERT_MSG_EQ (m_expired[nbC].size (), 1, "Returned neighbor not expired once");
+  NS_TEST_ASSERT_MSG_EQ (m_expired[nbD].size (), 1, "Neighbor off the granularity not expired once");
+  if (m_expired[nbA].size () == 1 && m_expired[nbB].size () == 1
+      && m_expired[nbC].size () == 1 && m_expired[nbD].size () == 1)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_expired[nbA][0], Seconds (6), "Refreshed neighbor expired at the wrong time");
+      NS_TEST_ASSERT_MSG_EQ (m_expired[nbB][0], Seconds (4), "Neighbor expired at the wrong time");
+      NS_TEST_ASSERT_MSG_EQ (m_expired[nbC][0], MilliSeconds (5200), "Returned neighbor expired at the wrong time");
+      NS_TEST_ASSERT_MSG_EQ (m_expired[nbD][0], MilliSeconds (4300), "Neighbor off the granularity expired at the wrong time");
+    }
+
+  // The wheel is empty and its timer stopped
+  NS_TEST_ASSERT_MSG_EQ (m_rtable.nb_wheel_count, 0, "Neighbors left in the wheel");
+  NS_TEST_ASSERT_MSG_EQ (m_rtable.nb_wheel_timer.IsRunning (), false, "Wheel timer runs without neighbors");
+
+  Simulator::Destroy ();
+}
+
+// Checks that hello messages diffuse the best pheromone of every
+// destination that is no neighbor, and that the receiver bootstraps
+// its virtual pheromone from them
+class AnthocnetHelloDiffusionTestCase : public TestCase
+{
+public:
+  AnthocnetHelloDiffusionTestCase ();
+  virtual ~AnthocnetHelloDiffusionTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetHelloDiffusionTestCase::AnthocnetHelloDiffusionTestCase ()
+  : TestCase ("Anthocnet hello diffusion")
+{
+}
+
+AnthocnetHelloDiffusionTestCase::~AnthocnetHelloDiffusionTestCase ()
+{
+}
+
+void
+AnthocnetHelloDiffusionTestCase::DoRun (void)
+{
+  // The cost of the link to the sender is its T_send
+  Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+  config->SetAttribute ("SnrCostMetric", BooleanValue (false));
+  Ptr<UniformRandomVariable> vr = CreateObject<UniformRandomVariable> ();
+  vr->SetStream (1);
+
+  Ipv4Address self ("10.0.0.1");
+  Ipv4Address nbA ("10.0.0.2");
+  Ipv4Address nbB ("10.0.0.3");
+  Ipv4Address d1 ("10.0.1.1");
+  Ipv4Address d2 ("10.0.1.2");
+  Ipv4Address d3 ("10.0.1.3");
+  Ipv4Address d4 ("10.0.1.4");
+
+  ahn::RoutingTable sender;
+  sender.SetConfig (config);
+  sender.AddNeighbor (nbA);
+  sender.AddNeighbor (nbB);
+  sender.AddDestination (d1);
+  sender.AddDestination (d2);
+  sender.AddDestination (d3);
+  sender.AddDestination (d4);
+
+  // Neighbors and destinations without pheromone are not diffused,
+  // the others with their best pheromone
+  sender.SetPheromone (nbA, nbA, 1.0, false);
+  sender.SetPheromone (d1, nbA, 0.5, false);
+  sender.SetPheromone (d2, nbA, 0.1, false);
+  sender.SetPheromone (d2, nbB, 0.4, false);
+  sender.SetPheromone (d3, nbB, 0.6, false);
+  sender.SetPheromone (d3, nbA, 0.2, true);
+  std::map<Ipv4Address, double> expected;
+  expected[d1] = 0.5;
+  expected[d2] = 0.4;
+  expected[d3] = 0.6;
+
+  // Room for all candidates
+  ahn::HelloMsgHeader msg (self);
+  sender.ConstructHelloMsg (msg, 10, vr);
+  NS_TEST_ASSERT_MSG_EQ (msg.GetSize (), 3, "Wrong number of diffused destinations");
+  while (msg.GetSize () != 0)
+    {
+      ahn::diffusion_t diff = msg.PopDiffusion ();
+      NS_TEST_ASSERT_MSG_EQ (expected.count (diff.first), 1, "Diffused " << diff.first);
+      NS_TEST_ASSERT_MSG_EQ_TOL (diff.second, expected[diff.first], 1e-9,
+                                 "Wrong pheromone diffused for " << diff.first);
+    }
+
+  // Fewer slots than candidates, every candidate has its chance
+  std::map<Ipv4Address, uint32_t> chosen;
+  for (uint32_t round = 0; round < 60; round++)
+    {
+      ahn::HelloMsgHeader part (self);
+      sender.ConstructHelloMsg (part, 2, vr);
+      NS_TEST_ASSERT_MSG_EQ (part.GetSize (), 2, "Slots of the hello message not filled");
+      std::vector<Ipv4Address> seen;
+      while (part.GetSize () != 0)
+        {
+          ahn::diffusion_t diff = part.PopDiffusion ();
+          NS_TEST_ASSERT_MSG_EQ (expected.count (diff.first), 1, "Selected " << diff.first);
+          NS_TEST_ASSERT_MSG_EQ_TOL (diff.second, expected[diff.first], 1e-9,
+                                     "Wrong pheromone selected for " << diff.first);
+          NS_TEST_ASSERT_MSG_EQ ((std::find (seen.begin (), seen.end (), diff.first) == seen.end ()), true,
+                                 "Selected " << diff.first << " twice");
+          seen.push_back (diff.first);
+          chosen[diff.first]++;
+        }
+    }
+  NS_TEST_ASSERT_MSG_GT (chosen[d1], 0, "d1 never selected");
+  NS_TEST_ASSERT_MSG_GT (chosen[d2], 0, "d2 never selected");
+  NS_TEST_ASSERT_MSG_GT (chosen[d3], 0, "d3 never selected");
+
+  ahn::RoutingTable receiver;
+  receiver.SetConfig (config);
+  receiver.AddNeighbor (self);
+  receiver.AddDestination (d1);
+  receiver.SetPheromone (d1, self, 0.3, false);
+
+  // Without an estimate of the time to the sender, nothing is learned
+  ahn::HelloMsgHeader early (self);
+  sender.ConstructHelloMsg (early, 10, vr);
+  receiver.HandleHelloMsg (early);
+  NS_TEST_ASSERT_MSG_EQ (receiver.GetPheromone (d2, self, true), 0, "Bootstrapped without T_send");
+
+  // The hello was acked after 10ms
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  receiver.ProcessAck (self, Seconds (1) - MilliSeconds (10));
+
+  ahn::HelloMsgHeader hello (self);
+  sender.ConstructHelloMsg (hello, 10, vr);
+  receiver.HandleHelloMsg (hello);
+  NS_TEST_ASSERT_MSG_EQ (receiver.IsDestination (d4), false, "Destination without pheromone learned");
+  NS_TEST_ASSERT_MSG_EQ_TOL (receiver.GetPheromone (d1, self, true), 1 / (1 / 0.5 + 10), 1e-9,
+                             "Wrong virtual pheromone for d1");
+  NS_TEST_ASSERT_MSG_EQ_TOL (receiver.GetPheromone (d2, self, true), 1 / (1 / 0.4 + 10), 1e-9,
+                             "Wrong virtual pheromone for d2");
+  NS_TEST_ASSERT_MSG_EQ_TOL (receiver.GetPheromone (d3, self, true), 1 / (1 / 0.6 + 10), 1e-9,
+                             "Wrong virtual pheromone for d3");
+
+  // Existing real pheromone is updated, but none is created
+  double gamma = config->gamma;
+  NS_TEST_ASSERT_MSG_EQ_TOL (receiver.GetPheromone (d1, self, false), gamma * 0.3 + (1 - gamma) / (1 / 0.5 + 10), 1e-9,
+                             "Real pheromone not updated");
+  NS_TEST_ASSERT_MSG_EQ (receiver.GetPheromone (d2, self, false), 0, "Real pheromone created by a hello");
+
+  // With the snr metric, a good link costs one
+  config->SetAttribute ("SnrCostMetric", BooleanValue (true));
+  receiver.SetLastSnr (self, config->snr_threshold + 1);
+  ahn::HelloMsgHeader snr (self);
+  sender.ConstructHelloMsg (snr, 10, vr);
+  receiver.HandleHelloMsg (snr);
+  NS_TEST_ASSERT_MSG_EQ_TOL (receiver.GetPheromone (d3, self, true), 1 / (1 / 0.6 + 1), 1e-9,
+                             "Wrong virtual pheromone with the snr metric");
+
+  Simulator::Destroy ();
+}
+
+class AnthocnetFisMfTestCase : public TestCase
+{
+public:
+  AnthocnetFisMfTestCase ();
+  virtual ~AnthocnetFisMfTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetFisMfTestCase::AnthocnetFisMfTestCase ()
+  : TestCase ("Anthocnet native fis membership functions")
+{
+}
+
+AnthocnetFisMfTestCase::~AnthocnetFisMfTestCase ()
+{
+}
+
+void
+AnthocnetFisMfTestCase::DoRun (void)
+{
+  ahn::FisMf trap = {ahn::FisMf::TRAPMF, {0.4, 0.5, 0.65, 0.75}};
+  NS_TEST_ASSERT_MSG_EQ_TOL (trap.Eval (0.3), 0.0, 1e-9, "Left of the support");
+  NS_TEST_ASSERT_MSG_EQ_TOL (trap.Eval (0.45), 0.5, 1e-9, "Wrong rising edge");
+  NS_TEST_ASSERT_MSG_EQ_TOL (trap.Eval (0.6), 1.0, 1e-9, "Wrong plateau");
+  NS_TEST_ASSERT_MSG_EQ_TOL (trap.Eval (0.725), 0.25, 1e-9, "Wrong falling edge");
+  NS_TEST_ASSERT_MSG_EQ_TOL (trap.Eval (0.8), 0.0, 1e-9, "Right of the support");
+
+  ahn::FisMf tri = {ahn::FisMf::TRIMF, {0, 1, 3, 0}};
+  NS_TEST_ASSERT_MSG_EQ_TOL (tri.Eval (1), 1.0, 1e-9, "Wrong peak");
+  NS_TEST_ASSERT_MSG_EQ_TOL (tri.Eval (2), 0.5, 1e-9, "Wrong falling edge");
+
+  // Parameters are [sigma mean] as in the .fis file
+  ahn::FisMf gauss = {ahn::FisMf::GAUSSMF, {0.1, 0.3, 0, 0}};
+  NS_TEST_ASSERT_MSG_EQ_TOL (gauss.Eval (0.3), 1.0, 1e-9, "Wrong mean");
+  NS_TEST_ASSERT_MSG_EQ_TOL (gauss.Eval (0.4), std::exp (-0.5), 1e-9, "Wrong sigma");
+}
+
+class AnthocnetFisMissingFileTestCase : public TestCase
+{
+public:
+  AnthocnetFisMissingFileTestCase ();
+  virtual ~AnthocnetFisMissingFileTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetFisMissingFileTestCase::AnthocnetFisMissingFileTestCase ()
+  : TestCase ("Anthocnet fis lookup table without a fis file")
+{
+}
+
+AnthocnetFisMissingFileTestCase::~AnthocnetFisMissingFileTestCase ()
+{
+}
+
+void
+AnthocnetFisMissingFileTestCase::DoRun (void)
+{
+  Ptr<ahn::AntHocNetFis> fis = CreateObject<ahn::AntHocNetFis> ();
+  fis->SetAttribute ("FisFile", StringValue ("does-not-exist.fis"));
+  fis->SetAttribute ("UseLookupTable", BooleanValue (true));
+  fis->Init ();
+
+  // No table is built, the engine reports that it is not ready
+  NS_TEST_ASSERT_MSG_EQ (std::isnan (fis->Eval (0.5, 0.5)), true,
+                         "Missing fis file did not yield NaN");
+}
+
+// Checks the native engine on the shipped fis against reference outputs.
+// The references were computed with the same Mamdani inference as
+// fuzzylite: min/max, 100 centroid samples at the interval midpoints.
+class AnthocnetFisReferenceTestCase : public TestCase
+{
+public:
+  AnthocnetFisReferenceTestCase ();
+  virtual ~AnthocnetFisReferenceTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetFisReferenceTestCase::AnthocnetFisReferenceTestCase ()
+  : TestCase ("Anthocnet native fis against reference outputs")
+{
+}
+
+AnthocnetFisReferenceTestCase::~AnthocnetFisReferenceTestCase ()
+{
+}
+
+void
+AnthocnetFisReferenceTestCase::DoRun (void)
+{
+  SetDataDir (NS_TEST_SOURCEDIR);
+  Ptr<ahn::AntHocNetFis> fis = CreateObject<ahn::AntHocNetFis> ();
+  fis->SetAttribute ("FisFile", StringValue (CreateDataDirFilename ("../fis/sniffer_analysis.fis")));
+  fis->Init ();
+
+  double rate[] = {0, 0.42, 0.5, 0.7, 0.72, 1.0};
+  double amount[] = {0, 6, 10, 14, 20, 30};
+  double reference[6][6] = {
+    {0.500000, 0.366465, 0.079822, 0.095324, 0.079822, 0.079822},
+    {0.546974, 0.426252, 0.265367, 0.296380, 0.182791, 0.182791},
+    {0.699558, 0.599479, 0.500000, 0.400521, 0.300442, 0.300442},
+    {0.699376, 0.656150, 0.633535, 0.520884, 0.502165, 0.502165},
+    {0.699492, 0.682314, 0.692935, 0.563247, 0.588386, 0.588386},
+    {0.699558, 0.756485, 0.920178, 0.904676, 0.920178, 0.920178},
+  };
+
+  for (uint32_t i = 0; i < 6; i++)
+    {
+      for (uint32_t j = 0; j < 6; j++)
+        {
+          NS_TEST_ASSERT_MSG_EQ_TOL (fis->Eval (rate[i], amount[j]), reference[i][j], 1e-5,
+                                     "Wrong output at " << rate[i] << ", " << amount[j]);
+        }
+    }
+}
+
+// Checks the interpolated lookup table against the engine
+class AnthocnetFisLookupTestCase : public TestCase
+{
+public:
+  AnthocnetFisLookupTestCase ();
+  virtual ~AnthocnetFisLookupTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetFisLookupTestCase::AnthocnetFisLookupTestCase ()
+  : TestCase ("Anthocnet fis lookup table error")
+{
+}
+
+AnthocnetFisLookupTestCase::~AnthocnetFisLookupTestCase ()
+{
+}
+
+void
+AnthocnetFisLookupTestCase::DoRun (void)
+{
+  SetDataDir (NS_TEST_SOURCEDIR);
+  std::string file = CreateDataDirFilename ("../fis/sniffer_analysis.fis");
+  uint32_t cells = 32;
+
+  Ptr<ahn::AntHocNetFis> engine = CreateObject<ahn::AntHocNetFis> ();
+  engine->SetAttribute ("FisFile", StringValue (file));
+  engine->Init ();
+
+  Ptr<ahn::AntHocNetFis> table = CreateObject<ahn::AntHocNetFis> ();
+  table->SetAttribute ("FisFile", StringValue (file));
+  table->SetAttribute ("UseLookupTable", BooleanValue (true));
+  table->SetAttribute ("LookupResolution", UintegerValue (cells));
+  table->Init ();
+
+  double error = table->GetLookupError ();
+  NS_TEST_ASSERT_MSG_GT (error, 0, "Lookup table without any error");
+  NS_TEST_ASSERT_MSG_LT (error, 0.25, "Lookup table error too large");
+
+  // On the grid the error was sampled on, it is a bound
+  double max_sampled = 0;
+  for (uint32_t i = 0; i <= 4 * cells; i++)
+    {
+      for (uint32_t j = 0; j <= 4 * cells; j++)
+        {
+          double in1 = i / (4.0 * cells);
+          double in2 = 30.0 * j / (4.0 * cells);
+          max_sampled = std::max (max_sampled,
+            std::fabs (table->Eval (in1, in2) - engine->Eval (in1, in2)));
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ_TOL (max_sampled, error, 1e-12, "Error not the maximum of the samples");
+
+  // In between, the estimate may be exceeded slightly
+  uint32_t steps = 301;
+  for (uint32_t i = 0; i <= steps; i++)
+    {
+      for (uint32_t j = 0; j <= steps; j++)
+        {
+          double in1 = i / (double) steps;
+          double in2 = 30.0 * j / steps;
+          double out = table->Eval (in1, in2);
+          NS_TEST_ASSERT_MSG_EQ (std::isnan (out), false, "Lookup table yields NaN");
+          NS_TEST_ASSERT_MSG_LT (std::fabs (out - engine->Eval (in1, in2)), 1.25 * error,
+                                 "Lookup table far off at " << in1 << ", " << in2);
+        }
+    }
+}
+
+class AnthocnetOutcomeWindowTestCase : public TestCase
+{
+public:
+  AnthocnetOutcomeWindowTestCase ();
+  virtual ~AnthocnetOutcomeWindowTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AnthocnetOutcomeWindowTestCase::AnthocnetOutcomeWindowTestCase ()
+  : TestCase ("Anthocnet fullfillment outcome window")
+{
+}
+
+AnthocnetOutcomeWindowTestCase::~AnthocnetOutcomeWindowTestCase ()
+{
+}
+
+void
+AnthocnetOutcomeWindowTestCase::DoRun (void)
+{
+  ahn::OutcomeWindow window;
+  window.Init (3);
+
+  window.Push (Seconds (1), true);
+  window.Push (Seconds (2), false);
+  window.Push (Seconds (3), true);
+  NS_TEST_ASSERT_MSG_EQ (window.GetSize (), 3, "Wrong number of outcomes");
+  NS_TEST_ASSERT_MSG_EQ (window.GetFullfilled (), 2, "Wrong number of fullfilled");
+
+  window.Age (Seconds (1.5));
+  NS_TEST_ASSERT_MSG_EQ (window.GetYoung (), 2, "Old outcome still young");
+
+  // The ring is full, the oldest outcome is dropped
+  window.Push (Seconds (4), false);
+  NS_TEST_ASSERT_MSG_EQ (window.GetSize (), 3, "Ring grew over its capacity");
+  NS_TEST_ASSERT_MSG_EQ (window.GetFullfilled (), 1, "Dropped outcome still counted");
+  NS_TEST_ASSERT_MSG_EQ (window.GetYoung (), 3, "Dropped outcome still old");
+
+  window.Age (Seconds (3));
+  NS_TEST_ASSERT_MSG_EQ (window.GetYoung (), 1, "Wrong number of young outcomes");
+
+  // A sampled outcome stands for several packets.
+  // The window holds the outcomes at 3, 4 and 5 seconds now.
+  window.Push (Seconds (5), true, 4);
+  NS_TEST_ASSERT_MSG_EQ_TOL (window.GetWeight (), 6.0, 1e-9, "Wrong total weight");
+  NS_TEST_ASSERT_MSG_EQ_TOL (window.GetFullfilledWeight (), 5.0, 1e-9, "Wrong fullfilled weight");
+  NS_TEST_ASSERT_MSG_EQ_TOL (window.GetYoungWeight (), 5.0, 1e-9, "Wrong young weight");
+}
+
+// A cached data packet of size bytes, errors are reported to ecb
+static ahn::CacheEntry
+MakeCacheEntry (uint32_t size, uint8_t tos, Ipv4RoutingProtocol::ErrorCallback ecb)
+{
+  ahn::CacheEntry ce;
+  ce.type = ahn::AHNTYPE_UNKNOWN;
+  ce.iface = 0;
+  ce.header.SetTos (tos);
+  ce.packet = Create<Packet> (size);
+  ce.ecb = ecb;
+  return ce;
+}
+
+// Checks that the expiry heap drops every expired packet exactly once
+class AnthocnetCacheExpiryTestCase : public TestCase
+{
+public:
+  AnthocnetCacheExpiryTestCase ();
+  virtual ~AnthocnetCacheExpiryTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  uint64_t Cache (Ipv4Address dst, Time expire);
+  void CacheLate (Ipv4Address dst, Time expire);
+  void Drop (ahn::CacheEntry ce, std::string reason);
+  void Error (Ptr<const Packet> p, const Ipv4Header &header, Socket::SocketErrno err);
+
+  ahn::PacketCache *m_cache;
+  uint64_t m_lateUid;
+  std::map<uint64_t, uint32_t> m_drops;
+  std::map<uint64_t, uint32_t> m_errors;
+  std::map<uint64_t, Time> m_dropTime;
+  std::map<uint64_t, std::string> m_reason;
+};
+
+AnthocnetCacheExpiryTestCase::AnthocnetCacheExpiryTestCase ()
+  : TestCase ("Anthocnet data cache expiry"),
+    m_cache (0),
+    m_lateUid (0)
+{
+}
+
+AnthocnetCacheExpiryTestCase::~AnthocnetCacheExpiryTestCase ()
+{
+}
+
+uint64_t
+AnthocnetCacheExpiryTestCase::Cache (Ipv4Address dst, Time expire)
+{
+  ahn::CacheEntry ce = MakeCacheEntry (100, 0,
+    MakeCallback (&AnthocnetCacheExpiryTestCase::Error, this));
+  uint64_t uid = ce.packet->GetUid ();
+  m_cache->CachePacket (dst, std::move (ce), expire);
+  return uid;
+}
+
+void
+AnthocnetCacheExpiryTestCase::CacheLate (Ipv4Address dst, Time expire)
+{
+  m_lateUid = Cache (dst, expire);
+}
+
+void
+AnthocnetCacheExpiryTestCase::Drop (ahn::CacheEntry ce, std::string reason)
+{
+  // Report the error like the routing protocol does
+  uint64_t uid = ce.packet->GetUid ();
+  m_drops[uid]++;
+  m_dropTime[uid] = Simulator::Now ();
+  m_reason[uid] = reason;
+  ce.ecb (ce.packet, ce.header, Socket::ERROR_NOROUTETOHOST);
+}
+
+void
+AnthocnetCacheExpiryTestCase::Error (Ptr<const Packet> p, const Ipv4Header &header, Socket::SocketErrno err)
+{
+  m_errors[p->GetUid ()]++;
+}
+
+void
+AnthocnetCacheExpiryTestCase::DoRun (void)
+{
+  Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+  ahn::PacketCache cache (config);
+  cache.SetDropCallback (MakeCallback (&AnthocnetCacheExpiryTestCase::Drop, this));
+  m_cache = &cache;
+
+  Ipv4Address a ("10.0.0.1");
+  Ipv4Address b ("10.0.0.2");
+
+  // The second packet expires earlier, the timer has to be moved
+  // forward, and it is taken out of the middle of the ring
+  uint64_t a1 = Cache (a, Seconds (5));
+  uint64_t a2 = Cache (a, Seconds (3));
+
+  // Taking and dropping packets leaves stale entries in the heap
+  uint64_t b1 = Cache (b, Seconds (4));
+  uint64_t b2 = Cache (b, Seconds (6));
+  uint64_t b3 = Cache (b, Seconds (7));
+  std::pair<bool, ahn::CacheEntry> taken = cache.GetCacheEntry (b);
+  NS_TEST_ASSERT_MSG_EQ (taken.first, true, "Packet not taken from the cache");
+  NS_TEST_ASSERT_MSG_EQ (taken.second.packet->GetUid (), b1, "Wrong packet taken");
+
+  Simulator::Schedule (Seconds (1), &ahn::PacketCache::DropCache, &cache, b,
+                       std::string ("Route discovery failed"));
+  Simulator::Schedule (Seconds (2), &AnthocnetCacheExpiryTestCase::CacheLate, this,
+                       b, Seconds (1));
+
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_drops.size (), 5, "Wrong number of dropped packets");
+  NS_TEST_ASSERT_MSG_EQ (m_drops.count (b1), 0, "Taken packet was dropped");
+
+  uint64_t uids[] = {a1, a2, b2, b3, m_lateUid};
+  for (uint32_t i = 0; i < 5; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_drops[uids[i]], 1, "Packet not dropped exactly once");
+      NS_TEST_ASSERT_MSG_EQ (m_errors[uids[i]], 1, "Error callback not called exactly once");
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (m_dropTime[a2], Seconds (3), "Earlier expiry not scheduled");
+  NS_TEST_ASSERT_MSG_EQ (m_dropTime[a1], Seconds (5), "Wrong expiry of the first packet");
+  NS_TEST_ASSERT_MSG_EQ (m_dropTime[m_lateUid], Seconds (3), "Wrong expiry of the late packet");
+  NS_TEST_ASSERT_MSG_EQ (m_reason[a1], "Cached and expired", "Wrong drop reason");
+  NS_TEST_ASSERT_MSG_EQ (m_reason[b2], "Route discovery failed", "Wrong drop reason");
+  NS_TEST_ASSERT_MSG_EQ (m_dropTime[b3], Seconds (1), "Dropped packet expired again");
+
+  NS_TEST_ASSERT_MSG_EQ (cache.HasEntries (a), false, "Expired packets left in the cache");
+  NS_TEST_ASSERT_MSG_EQ (cache.HasEntries (b), false, "Expired packets left in the cache");
+}
+
+// Checks which packet the drop policies remove from a full data cache
+class AnthocnetCacheDropPolicyTestCase : public TestCase
+{
+public:
+  AnthocnetCacheDropPolicyTestCase ();
+  virtual ~AnthocnetCacheDropPolicyTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Reset (ahn::PacketCache *cache);
+  void Cache (Ipv4Address dst, uint32_t size, uint8_t tos);
+  void Drop (ahn::CacheEntry ce, std::string reason);
+  // Uid of the next packet to dst, or 0 if there is none
+  uint64_t Take (Ipv4Address dst);
+
+  ahn::PacketCache *m_cache;
+  std::vector<uint64_t> m_cached;
+  std::vector<uint64_t> m_dropped;
+};
+
+AnthocnetCacheDropPolicyTestCase::AnthocnetCacheDropPolicyTestCase ()
+  : TestCase ("Anthocnet data cache drop policies"),
+    m_cache (0)
+{
+}
+
+AnthocnetCacheDropPolicyTestCase::~AnthocnetCacheDropPolicyTestCase ()
+{
+}
+
+void
+AnthocnetCacheDropPolicyTestCase::Reset (ahn::PacketCache *cache)
+{
+  m_cache = cache;
+  m_cache->SetDropCallback (MakeCallback (&AnthocnetCacheDropPolicyTestCase::Drop, this));
+  m_cached.clear ();
+  m_dropped.clear ();
+}
+
+void
+AnthocnetCacheDropPolicyTestCase::Cache (Ipv4Address dst, uint32_t size, uint8_t tos)
+{
+  ahn::CacheEntry ce = MakeCacheEntry (size, tos, Ipv4RoutingProtocol::ErrorCallback ());
+  m_cached.push_back (ce.packet->GetUid ());
+  m_cache->CachePacket (dst, std::move (ce), Seconds (100));
+}
+
+void
+AnthocnetCacheDropPolicyTestCase::Drop (ahn::CacheEntry ce, std::string reason)
+{
+  m_dropped.push_back (ce.packet->GetUid ());
+}
+
+uint64_t
+AnthocnetCacheDropPolicyTestCase::Take (Ipv4Address dst)
+{
+  std::pair<bool, ahn::CacheEntry> ce = m_cache->GetCacheEntry (dst);
+  return ce.first ? ce.second.packet->GetUid () : 0;
+}
+
+void
+AnthocnetCacheDropPolicyTestCase::DoRun (void)
+{
+  Ipv4Address a ("10.0.0.1");
+  Ipv4Address b ("10.0.0.2");
+
+  // The oldest packet of the node is dropped, even if it belongs
+  // to another destination than the incoming one
+  {
+    Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+    config->SetAttribute ("DataCacheDropPolicy", EnumValue (ahn::CACHE_DROP_OLDEST));
+    config->SetAttribute ("DataCacheMaxPackets", UintegerValue (0));
+    config->SetAttribute ("DataCacheMaxBytes", UintegerValue (0));
+    config->SetAttribute ("DataCacheNodeMaxPackets", UintegerValue (3));
+    config->SetAttribute ("DataCacheNodeMaxBytes", UintegerValue (0));
+    ahn::PacketCache cache (config);
+    Reset (&cache);
+
+    Simulator::Schedule (Seconds (1), &AnthocnetCacheDropPolicyTestCase::Cache, this, b, 100, 0);
+    Simulator::Schedule (Seconds (2), &AnthocnetCacheDropPolicyTestCase::Cache, this, a, 100, 0);
+    Simulator::Schedule (Seconds (3), &AnthocnetCacheDropPolicyTestCase::Cache, this, a, 100, 0);
+    Simulator::Schedule (Seconds (4), &AnthocnetCacheDropPolicyTestCase::Cache, this, a, 100, 0);
+    Simulator::Stop (Seconds (5));
+    Simulator::Run ();
+
+    NS_TEST_ASSERT_MSG_EQ (m_dropped.size (), 1, "Wrong number of drops");
+    NS_TEST_ASSERT_MSG_EQ (m_dropped[0], m_cached[0], "Oldest packet of the node not dropped");
+    NS_TEST_ASSERT_MSG_EQ (cache.HasEntries (b), false, "Victim still cached");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), m_cached[1], "Wrong order after the drop");
+    Simulator::Destroy ();
+  }
+
+  // A full destination rejects the incoming packet
+  {
+    Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+    config->SetAttribute ("DataCacheDropPolicy", EnumValue (ahn::CACHE_DROP_NEWEST));
+    config->SetAttribute ("DataCacheMaxPackets", UintegerValue (2));
+    config->SetAttribute ("DataCacheMaxBytes", UintegerValue (0));
+    ahn::PacketCache cache (config);
+    Reset (&cache);
+
+    Cache (a, 100, 0);
+    Cache (a, 100, 0);
+    Cache (a, 100, 0);
+
+    NS_TEST_ASSERT_MSG_EQ (m_dropped.size (), 1, "Wrong number of drops");
+    NS_TEST_ASSERT_MSG_EQ (m_dropped[0], m_cached[2], "Incoming packet not dropped");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), m_cached[0], "Cached packet lost");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), m_cached[1], "Cached packet lost");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), 0, "Dropped packet was cached");
+  }
+
+  // The packet with the lowest ToS is dropped, which can be the incoming one
+  {
+    Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+    config->SetAttribute ("DataCacheDropPolicy", EnumValue (ahn::CACHE_DROP_LOWEST_PRIORITY));
+    config->SetAttribute ("DataCacheMaxPackets", UintegerValue (2));
+    config->SetAttribute ("DataCacheMaxBytes", UintegerValue (0));
+    ahn::PacketCache cache (config);
+    Reset (&cache);
+
+    Cache (a, 100, 20);
+    Cache (a, 100, 10);
+    Cache (a, 100, 5);
+    NS_TEST_ASSERT_MSG_EQ (m_dropped.size (), 1, "Wrong number of drops");
+    NS_TEST_ASSERT_MSG_EQ (m_dropped[0], m_cached[2], "Incoming packet with the lowest ToS not dropped");
+
+    Cache (a, 100, 30);
+    NS_TEST_ASSERT_MSG_EQ (m_dropped.size (), 2, "Wrong number of drops");
+    NS_TEST_ASSERT_MSG_EQ (m_dropped[1], m_cached[1], "Cached packet with the lowest ToS not dropped");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), m_cached[0], "Wrong order after the drop");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), m_cached[3], "Wrong order after the drop");
+  }
+
+  // A packet, that exceeds the byte limit on its own, evicts nothing
+  {
+    Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+    config->SetAttribute ("DataCacheDropPolicy", EnumValue (ahn::CACHE_DROP_OLDEST));
+    config->SetAttribute ("DataCacheMaxPackets", UintegerValue (0));
+    config->SetAttribute ("DataCacheMaxBytes", UintegerValue (500));
+    ahn::PacketCache cache (config);
+    Reset (&cache);
+
+    Cache (a, 100, 0);
+    Cache (a, 100, 0);
+    Cache (a, 1000, 0);
+    NS_TEST_ASSERT_MSG_EQ (m_dropped.size (), 1, "Wrong number of drops");
+    NS_TEST_ASSERT_MSG_EQ (m_dropped[0], m_cached[2], "Oversized packet not dropped");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), m_cached[0], "Packet evicted for an oversized one");
+    NS_TEST_ASSERT_MSG_EQ (Take (a), m_cached[1], "Packet evicted for an oversized one");
+  }
+}
+
+// Checks the ring of a destination, while packets are taken
+// from the front and evicted from the middle
+class AnthocnetCacheRingTestCase : public TestCase
+{
+public:
+  AnthocnetCacheRingTestCase ();
+  virtual ~AnthocnetCacheRingTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  uint64_t Cache (uint32_t size, uint8_t tos, Ipv4RoutingProtocol::ErrorCallback ecb);
+  void ErrorA (Ptr<const Packet> p, const Ipv4Header &header, Socket::SocketErrno err);
+  void ErrorB (Ptr<const Packet> p, const Ipv4Header &header, Socket::SocketErrno err);
+
+  ahn::PacketCache *m_cache;
+  Ipv4Address m_dst;
+};
+
+AnthocnetCacheRingTestCase::AnthocnetCacheRingTestCase ()
+  : TestCase ("Anthocnet data cache ring"),
+    m_cache (0),
+    m_dst ("10.0.0.1")
+{
+}
+
+AnthocnetCacheRingTestCase::~AnthocnetCacheRingTestCase ()
+{
+}
+
+uint64_t
+AnthocnetCacheRingTestCase::Cache (uint32_t size, uint8_t tos, Ipv4RoutingProtocol::ErrorCallback ecb)
+{
+  ahn::CacheEntry ce = MakeCacheEntry (size, tos, ecb);
+  uint64_t uid = ce.packet->GetUid ();
+  m_cache->CachePacket (m_dst, std::move (ce), Seconds (100));
+  return uid;
+}
+
+void
+AnthocnetCacheRingTestCase::ErrorA (Ptr<const Packet> p, const Ipv4Header &header, Socket::SocketErrno err)
+{
+}
+
+void
+AnthocnetCacheRingTestCase::ErrorB (Ptr<const Packet> p, const Ipv4Header &header, Socket::SocketErrno err)
+{
+}
+
+void
+AnthocnetCacheRingTestCase::DoRun (void)
+{
+  Ptr<ahn::AntHocNetConfig> config = CreateObject<ahn::AntHocNetConfig> ();
+  config->SetAttribute ("DataCacheDropPolicy", EnumValue (ahn::CACHE_DROP_LOWEST_PRIORITY));
+  config->SetAttribute ("DataCacheMaxPackets", UintegerValue (4));
+  config->SetAttribute ("DataCacheMaxBytes", UintegerValue (0));
+  config->SetAttribute ("DataCacheNodeMaxPackets", UintegerValue (0));
+  config->SetAttribute ("DataCacheNodeMaxBytes", UintegerValue (0));
+  ahn::PacketCache cache (config);
+  m_cache = &cache;
+
+  Ipv4RoutingProtocol::ErrorCallback a = MakeCallback (&AnthocnetCacheRingTestCase::ErrorA, this);
+  Ipv4RoutingProtocol::ErrorCallback b = MakeCallback (&AnthocnetCacheRingTestCase::ErrorB, this);
+  uint32_t header = Ipv4Header ().GetSerializedSize ();
+
+  uint64_t p0 = Cache (100, 10, a);
+  uint64_t p1 = Cache (200, 10, a);
+  Cache (300, 5, b);
+  uint64_t p3 = Cache (400, 10, a);
+
+  ahn::dst_cache_t &dc = cache.cache[m_dst];
+  NS_TEST_ASSERT_MSG_EQ (dc.ring.size (), 4, "Wrong initial ring size");
+  NS_TEST_ASSERT_MSG_EQ (dc.flows.size (), 2, "Wrong number of flows");
+  NS_TEST_ASSERT_MSG_EQ (dc.flows[0].refs, 3, "Wrong references of the first flow");
+  NS_TEST_ASSERT_MSG_EQ (dc.flows[1].refs, 1, "Wrong references of the second flow");
+
+  // Taking the front and caching again wraps the ring
+  std::pair<bool, ahn::CacheEntry> ce = cache.GetCacheEntry (m_dst);
+  NS_TEST_ASSERT_MSG_EQ (ce.second.packet->GetUid (), p0, "Front is not the oldest packet");
+  NS_TEST_ASSERT_MSG_EQ (ce.second.ecb.IsEqual (a), true, "Callback of the flow lost");
+  uint64_t p4 = Cache (500, 10, a);
+  NS_TEST_ASSERT_MSG_EQ (dc.head, 1, "Front was not advanced");
+  NS_TEST_ASSERT_MSG_EQ (dc.ring.size (), 4, "Ring grew before it was full");
+
+  // The cache is full, the packet with the lowest ToS in the middle
+  // of the ring is evicted. The ring is full including the hole,
+  // so it grows while it is wrapped.
+  uint64_t p5 = Cache (600, 10, b);
+  NS_TEST_ASSERT_MSG_EQ (dc.ring.size (), 8, "Ring did not grow");
+  NS_TEST_ASSERT_MSG_EQ (dc.head, 0, "Grown ring does not start at the front");
+  NS_TEST_ASSERT_MSG_EQ (dc.count, 5, "Hole not counted");
+  NS_TEST_ASSERT_MSG_EQ (dc.live, 4, "Wrong number of live packets");
+  NS_TEST_ASSERT_MSG_EQ (dc.bytes, 200 + 400 + 500 + 600 + 4 * header, "Wrong number of bytes");
+  NS_TEST_ASSERT_MSG_EQ (cache.total_packets, 4, "Wrong number of packets of the node");
+  NS_TEST_ASSERT_MSG_EQ (cache.total_bytes, dc.bytes, "Wrong number of bytes of the node");
+  NS_TEST_ASSERT_MSG_EQ (dc.At (1).packet == 0, true, "Evicted packet did not leave a hole");
+
+  // The flow of the evicted packet was released and is reused
+  NS_TEST_ASSERT_MSG_EQ (dc.flows.size (), 2, "Released flow not reused");
+  NS_TEST_ASSERT_MSG_EQ (dc.flows[0].refs, 3, "Wrong references of the first flow");
+  NS_TEST_ASSERT_MSG_EQ (dc.flows[1].refs, 1, "Wrong references of the reused flow");
+
+  // The packets leave in order, the hole is skipped
+  uint64_t order[] = {p1, p3, p4, p5};
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      ce = cache.GetCacheEntry (m_dst);
+      NS_TEST_ASSERT_MSG_EQ (ce.first, true, "Packet missing");
+      NS_TEST_ASSERT_MSG_EQ (ce.second.packet->GetUid (), order[i], "Packets not in FIFO order");
+      NS_TEST_ASSERT_MSG_EQ (ce.second.ecb.IsEqual (i == 3 ? b : a), true, "Wrong callback of the flow");
+      NS_TEST_ASSERT_MSG_EQ (dc.live, 3 - i, "Wrong number of live packets");
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (cache.GetCacheEntry (m_dst).first, false, "Drained cache returned a packet");
+  NS_TEST_ASSERT_MSG_EQ (dc.count, 0, "Drained ring still has slots");
+  NS_TEST_ASSERT_MSG_EQ (dc.bytes, 0, "Drained ring still has bytes");
+  NS_TEST_ASSERT_MSG_EQ (cache.total_packets, 0, "Node still has packets");
+  NS_TEST_ASSERT_MSG_EQ (cache.total_bytes, 0, "Node still has bytes");
+  NS_TEST_ASSERT_MSG_EQ (dc.flows[0].refs + dc.flows[1].refs, 0, "Flow still referenced");
+  NS_TEST_ASSERT_MSG_EQ (dc.flows[0].ecb.IsNull (), true, "Released flow keeps its callback");
+  NS_TEST_ASSERT_MSG_EQ (dc.ring.size (), 8, "Drained ring lost its storage");
+
+  Simulator::Destroy ();
+}
+
+// A node running AntHocNet on a single simple device
+static Ptr<ahn::RoutingProtocol>
+CreateAntHocNetNode (Ptr<Node> node, Ptr<SimpleChannel> channel, Ipv4Address address)
+{
+  Ptr<SimpleNetDevice> device = CreateObject<SimpleNetDevice> ();
+  device->SetAddress (Mac48Address::Allocate ());
+  device->SetChannel (channel);
+  node->AddDevice (device);
+
+  AntHocNetHelper antHocNet;
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (antHocNet);
+  internet.Install (node);
+
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  uint32_t iface = ipv4->AddInterface (device);
+  ipv4->AddAddress (iface, Ipv4InterfaceAddress (address, Ipv4Mask ("255.255.255.0")));
+  ipv4->SetUp (iface);
+
+  return node->GetObject<ahn::RoutingProtocol> ();
+}
+
+// Checks that cached data is paced out in batches, and that a new
+// discovery starts, if the route breaks during the drain
+class AnthocnetCachePacingTestCase : public TestCase
+{
+public:
+  AnthocnetCachePacingTestCase ();
+  virtual ~AnthocnetCachePacingTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Cache (Ipv4Address dst);
+  void Fill (void);
+  void BreakRoute (void);
+  void Check (void);
+  void Forward (Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header);
+
+  Ptr<ahn::RoutingProtocol> m_proto;
+  Ipv4Address m_nb;
+  Ipv4Address m_far;
+  std::vector<Time> m_nbTimes;
+  std::vector<Time> m_farTimes;
+  uint32_t m_wrongGateway;
+  bool m_pending;
+  bool m_cached;
+  bool m_draining;
+};
+
+AnthocnetCachePacingTestCase::AnthocnetCachePacingTestCase ()
+  : TestCase ("Anthocnet paced data cache drain"),
+    m_nb ("10.0.0.2"),
+    m_far ("10.0.0.3"),
+    m_wrongGateway (0),
+    m_pending (false),
+    m_cached (false),
+    m_draining (true)
+{
+}
+
+AnthocnetCachePacingTestCase::~AnthocnetCachePacingTestCase ()
+{
+}
+
+void
+AnthocnetCachePacingTestCase::Cache (Ipv4Address dst)
+{
+  ahn::CacheEntry ce = MakeCacheEntry (100, 0, Ipv4RoutingProtocol::ErrorCallback ());
+  ce.header.SetSource (Ipv4Address ("10.0.0.1"));
+  ce.header.SetDestination (dst);
+  ce.ucb = MakeCallback (&AnthocnetCachePacingTestCase::Forward, this);
+  m_proto->data_cache.CachePacket (dst, std::move (ce));
+}
+
+void
+AnthocnetCachePacingTestCase::Fill (void)
+{
+  // A neighbor, and a destination behind it
+  m_proto->rtable.AddNeighbor (m_nb);
+  m_proto->rtable.AddDestination (m_far);
+  m_proto->rtable.SetPheromone (m_nb, m_nb, 1.0, false);
+  m_proto->rtable.SetPheromone (m_far, m_nb, 1.0, false);
+
+  for (uint32_t i = 0; i < 6; i++)
+    {
+      Cache (m_nb);
+    }
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      Cache (m_far);
+    }
+
+  m_proto->SendCachedData (m_nb);
+  m_proto->SendCachedData (m_far);
+}
+
+void
+AnthocnetCachePacingTestCase::BreakRoute (void)
+{
+  m_proto->rtable.RemovePheromone (m_far, m_nb);
+}
+
+void
+AnthocnetCachePacingTestCase::Check (void)
+{
+  m_pending = m_proto->IsDiscoveryPending (m_far);
+  m_cached = m_proto->data_cache.HasEntries (m_far);
+  m_draining = m_proto->IsDraining (m_far);
+}
+
+void
+AnthocnetCachePacingTestCase::Forward (Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header)
+{
+  if (route->GetGateway () != m_nb)
+    {
+      m_wrongGateway++;
+    }
+
+  if (header.GetDestination () == m_nb)
+    {
+      m_nbTimes.push_back (Simulator::Now ());
+    }
+  else
+    {
+      m_farTimes.push_back (Simulator::Now ());
+    }
+}
+
+void
+AnthocnetCachePacingTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<SimpleChannel> channel = CreateObject<SimpleChannel> ();
+  m_proto = CreateAntHocNetNode (node, channel, Ipv4Address ("10.0.0.1"));
+
+  // A fixed gap between the batches
+  Ptr<ahn::AntHocNetConfig> config = m_proto->GetConfig ();
+  config->SetAttribute ("DataCachePacing", BooleanValue (true));
+  config->SetAttribute ("DataCacheBatchSize", UintegerValue (2));
+  config->SetAttribute ("DataCachePacingMin", TimeValue (MilliSeconds (50)));
+  config->SetAttribute ("DataCachePacingMax", TimeValue (MilliSeconds (50)));
+
+  Simulator::Schedule (Seconds (0.5), &AnthocnetCachePacingTestCase::Fill, this);
+  Simulator::Schedule (Seconds (0.51), &AnthocnetCachePacingTestCase::BreakRoute, this);
+  Simulator::Schedule (Seconds (0.56), &AnthocnetCachePacingTestCase::Check, this);
+  Simulator::Stop (Seconds (0.9));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_nbTimes.size (), 6, "Not all cached packets sent");
+  for (uint32_t i = 0; i < m_nbTimes.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_nbTimes[i], Seconds (0.5) + MilliSeconds (50) * (i / 2),
+                             "Packet " << i << " not sent with its batch");
+    }
+  NS_TEST_ASSERT_MSG_EQ (m_wrongGateway, 0, "Packet sent to the wrong neighbor");
+
+  // Only the first batch made it before the route broke
+  NS_TEST_ASSERT_MSG_EQ (m_farTimes.size (), 2, "Packets sent without a route");
+  NS_TEST_ASSERT_MSG_EQ (m_pending, true, "No discovery after the route broke");
+  NS_TEST_ASSERT_MSG_EQ (m_cached, true, "Remaining packets not kept in the cache");
+  NS_TEST_ASSERT_MSG_EQ (m_draining, false, "Drain continued without a route");
+
+  m_proto = 0;
+  Simulator::Destroy ();
+}
+
+// Checks that overheard addresses neither keep a mac cache entry alive
+// nor replace the addresses from the arp caches, and that expired
+// entries are pruned
+class AnthocnetMacCacheTestCase : public TestCase
+{
+public:
+  AnthocnetMacCacheTestCase ();
+  virtual ~AnthocnetMacCacheTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Advance (Time delay);
+};
+
+AnthocnetMacCacheTestCase::AnthocnetMacCacheTestCase ()
+  : TestCase ("Anthocnet mac cache")
+{
+}
+
+AnthocnetMacCacheTestCase::~AnthocnetMacCacheTestCase ()
+{
+}
+
+void
+AnthocnetMacCacheTestCase::Advance (Time delay)
+{
+  Simulator::Stop (delay);
+  Simulator::Run ();
+}
+
+void
+AnthocnetMacCacheTestCase::DoRun (void)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<SimpleChannel> channel = CreateObject<SimpleChannel> ();
+  Ptr<ahn::RoutingProtocol> proto = CreateAntHocNetNode (node, channel, Ipv4Address ("10.0.0.1"));
+  Time expire = proto->GetConfig ()->mac_cache_expire;
+
+  Mac48Address mac = Mac48Address::Allocate ();
+  Ipv4Address a ("10.0.0.2");
+  Ipv4Address b ("10.0.0.3");
+
+  Advance (Seconds (1));
+  proto->LearnMacAddress (mac, a);
+  NS_TEST_ASSERT_MSG_EQ (proto->LookupMacAddress (mac).size (), 1, "Overheard address not learned");
+  NS_TEST_ASSERT_MSG_EQ (proto->LookupMacAddress (mac)[0], a, "Wrong address learned");
+
+  // Overhearing again does not extend the entry
+  Advance (expire / 2);
+  proto->LearnMacAddress (mac, b);
+  NS_TEST_ASSERT_MSG_EQ (proto->LookupMacAddress (mac).size (), 2, "Second address not learned");
+  NS_TEST_ASSERT_MSG_EQ (proto->mac_cache[mac].expire, Seconds (1) + expire, "Overheard address extended the entry");
+
+  // Once expired, the arp caches are asked. They know nothing here,
+  // and that result is not replaced by overheard addresses.
+  Advance (expire / 2);
+  NS_TEST_ASSERT_MSG_EQ (proto->LookupMacAddress (mac).size (), 0, "Arp caches not asked after the expiry");
+  proto->LearnMacAddress (mac, a);
+  NS_TEST_ASSERT_MSG_EQ (proto->LookupMacAddress (mac).size (), 0, "Overheard address replaced the arp result");
+
+  // Expired entries are pruned with the routing table update
+  proto->LearnMacAddress (Mac48Address::Allocate (), b);
+  NS_TEST_ASSERT_MSG_EQ (proto->mac_cache.size (), 2, "Wrong number of cached macs");
+  Advance (expire);
+  proto->RTableTimerExpire ();
+  NS_TEST_ASSERT_MSG_EQ (proto->mac_cache.size (), 0, "Expired macs not pruned");
+
+  proto = 0;
+  Simulator::Destroy ();
+}
+
+// Checks the parser of sniffed frames on hand built 802.11 data frames,
+// including truncated ones
+class AnthocnetSniffParserTestCase : public TestCase
+{
+public:
+  AnthocnetSniffParserTestCase ();
+  virtual ~AnthocnetSniffParserTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  // Writes a data frame carrying an ant from 10.0.0.2 to 10.0.0.255.
+  // Returns its length.
+  uint32_t BuildFrame (uint8_t *buf, bool fourAddresses, uint8_t ihl);
+  bool Parse (const uint8_t *buf, uint32_t len, ahn::sniffed_frame_t &frame);
+};
+
+AnthocnetSniffParserTestCase::AnthocnetSniffParserTestCase ()
+  : TestCase ("Anthocnet sniffed frame parser")
+{
+}
+
+AnthocnetSniffParserTestCase::~AnthocnetSniffParserTestCase ()
+{
+}
+
+uint32_t
+AnthocnetSniffParserTestCase::BuildFrame (uint8_t *buf, bool fourAddresses, uint8_t ihl)
+{
+  uint32_t pos = 0;
+
+  // Frame control of a plain data frame, duration, addresses, sequence control
+  buf[pos++] = 0x08;
+  buf[pos++] = fourAddresses ? 0x03 : 0x00;
+  buf[pos++] = 0;
+  buf[pos++] = 0;
+  for (uint8_t a = 1; a <= (fourAddresses ? 4 : 3); a++)
+    {
+      for (uint32_t i = 0; i < 6; i++)
+        {
+          buf[pos++] = (i == 5) ? a : 0;
+        }
+      if (a == 3)
+        {
+          buf[pos++] = 0;
+          buf[pos++] = 0;
+        }
+    }
+
+  // LLC/SNAP with the ethertype of IPv4
+  const uint8_t llc[] = { 0xAA, 0xAA, 0x03, 0x00, 0x00, 0x00, 0x08, 0x00 };
+  for (uint32_t i = 0; i < 8; i++)
+    {
+      buf[pos++] = llc[i];
+    }
+
+  // IPv4 header, options are zero
+  uint8_t *ip = buf + pos;
+  for (uint32_t i = 0; i < ihl * 4u; i++)
+    {
+      ip[i] = 0;
+    }
+  ip[0] = 0x40 | ihl;
+  ip[8] = 64;
+  ip[9] = 17;
+  const uint8_t src[] = { 10, 0, 0, 2 };
+  const uint8_t dst[] = { 10, 0, 0, 255 };
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      ip[12 + i] = src[i];
+      ip[16 + i] = dst[i];
+    }
+  pos += ihl * 4;
+
+  // UDP ports
+  buf[pos++] = 5555 >> 8;
+  buf[pos++] = 5555 & 0xFF;
+  buf[pos++] = 5555 >> 8;
+  buf[pos++] = 5555 & 0xFF;
+  return pos;
+}
+
+bool
+AnthocnetSniffParserTestCase::Parse (const uint8_t *buf, uint32_t len, ahn::sniffed_frame_t &frame)
+{
+  Ptr<Packet> packet = Create<Packet> (buf, len);
+  return ahn::RoutingProtocol::ParseSniffedFrame (packet, frame);
+}
+
+void
+AnthocnetSniffParserTestCase::DoRun (void)
+{
+  uint8_t buf[SNIFF_PARSE_SIZE];
+  ahn::sniffed_frame_t frame;
+  uint8_t macBytes[6] = { 0, 0, 0, 0, 0, 0 };
+
+  uint32_t len = BuildFrame (buf, false, 5);
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, len, frame), true, "Data frame not parsed");
+  NS_TEST_ASSERT_MSG_EQ (frame.n_addr, 3, "Wrong number of addresses");
+  for (uint32_t a = 0; a < 3; a++)
+    {
+      Mac48Address mac;
+      macBytes[5] = a + 1;
+      mac.CopyFrom (macBytes);
+      NS_TEST_ASSERT_MSG_EQ ((frame.addr[a] == mac), true, "Wrong address " << a);
+    }
+  NS_TEST_ASSERT_MSG_EQ (frame.is_ipv4, true, "IPv4 header not found");
+  NS_TEST_ASSERT_MSG_EQ (frame.src, Ipv4Address ("10.0.0.2"), "Wrong source");
+  NS_TEST_ASSERT_MSG_EQ (frame.dst, Ipv4Address ("10.0.0.255"), "Wrong destination");
+  NS_TEST_ASSERT_MSG_EQ (frame.is_udp, true, "UDP header not found");
+  NS_TEST_ASSERT_MSG_EQ (frame.src_port, 5555, "Wrong source port");
+
+  // Truncated inside the mac header
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, 23, frame), false, "Truncated mac header parsed");
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, 0, frame), false, "Empty frame parsed");
+
+  // Truncated inside the IPv4 header, the mac addresses are still usable
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, 24 + 8 + 19, frame), true, "Mac header not parsed");
+  NS_TEST_ASSERT_MSG_EQ (frame.n_addr, 3, "Wrong number of addresses in a short frame");
+  NS_TEST_ASSERT_MSG_EQ (frame.is_ipv4, false, "Truncated IPv4 header parsed");
+  NS_TEST_ASSERT_MSG_EQ (frame.is_udp, false, "UDP without an IPv4 header");
+
+  // Truncated before the UDP ports
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, 24 + 8 + 21, frame), true, "Frame without ports not parsed");
+  NS_TEST_ASSERT_MSG_EQ (frame.is_ipv4, true, "IPv4 header not found before the ports");
+  NS_TEST_ASSERT_MSG_EQ (frame.is_udp, false, "Truncated UDP ports parsed");
+
+  // Not IPv4, but ARP
+  buf[24 + 7] = 0x06;
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, len, frame), true, "Arp frame not parsed");
+  NS_TEST_ASSERT_MSG_EQ (frame.is_ipv4, false, "Arp frame taken for IPv4");
+  buf[24 + 7] = 0x00;
+
+  // Not a data frame, but a beacon
+  buf[0] = 0x80;
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, len, frame), false, "Beacon parsed");
+
+  // Four addresses and IPv4 options move the ports
+  len = BuildFrame (buf, true, 6);
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, len, frame), true, "Four address frame not parsed");
+  NS_TEST_ASSERT_MSG_EQ (frame.n_addr, 4, "Fourth address not found");
+  Mac48Address mac;
+  macBytes[5] = 4;
+  mac.CopyFrom (macBytes);
+  NS_TEST_ASSERT_MSG_EQ ((frame.addr[3] == mac), true, "Wrong fourth address");
+  NS_TEST_ASSERT_MSG_EQ (frame.src, Ipv4Address ("10.0.0.2"), "Wrong source behind four addresses");
+  NS_TEST_ASSERT_MSG_EQ (frame.is_udp, true, "UDP header not found behind the options");
+  NS_TEST_ASSERT_MSG_EQ (frame.src_port, 5555, "Wrong source port behind the options");
+  NS_TEST_ASSERT_MSG_EQ (Parse (buf, 29, frame), false, "Truncated fourth address parsed");
+}
+
+// Checks that a discovery to an unreachable destination is retried with
+// a doubling backoff, that data waits on the loopback meanwhile, and that
+// the cached data is dropped through its error callback in the end
+class AnthocnetUnreachableTestCase : public TestCase
+{
+public:
+  AnthocnetUnreachableTestCase ();
+  virtual ~AnthocnetUnreachableTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  void Send (void);
+  void CheckPending (void);
+  void Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t iface);
+  void Drop (const Ipv4Header &header, Ptr<const Packet> packet,
+             Ipv4L3Protocol::DropReason reason, Ptr<Ipv4> ipv4, uint32_t iface);
+  void DataDrop (Ptr<const Packet> packet, std::string reason, Ipv4Address src);
+
+  Ptr<Node> m_node;
+  Ptr<ahn::RoutingProtocol> m_proto;
+  Ptr<Socket> m_socket;
+  Ipv4Address m_dst;
+  std::vector<Time> m_antTimes;
+  std::vector<Time> m_errorTimes;
+  std::vector<Time> m_dropTimes;
+  bool m_loopback;
+};
+
+AnthocnetUnreachableTestCase::AnthocnetUnreachableTestCase ()
+  : TestCase ("Anthocnet unreachable destination discovery"),
+    m_dst ("10.0.0.99"),
+    m_loopback (false)
+{
+}
+
+AnthocnetUnreachableTestCase::~AnthocnetUnreachableTestCase ()
+{
+}
+
+void
+AnthocnetUnreachableTestCase::Send (void)
+{
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      m_socket->SendTo (Create<Packet> (100), 0, InetSocketAddress (m_dst, 9));
+    }
+}
+
+void
+AnthocnetUnreachableTestCase::CheckPending (void)
+{
+  Ptr<Packet> p = Create<Packet> (100);
+  UdpHeader udp;
+  udp.SetSourcePort (9);
+  udp.SetDestinationPort (9);
+  p->AddHeader (udp);
+
+  Ipv4Header header;
+  header.SetSource (Ipv4Address ("10.0.0.1"));
+  header.SetDestination (m_dst);
+
+  Socket::SocketErrno err;
+  Ptr<Ipv4Route> route = m_proto->RouteOutput (p, header, 0, err);
+  m_loopback = route != 0
+    && route->GetGateway () == Ipv4Address ("127.0.0.1")
+    && route->GetOutputDevice () == m_node->GetObject<Ipv4> ()->GetNetDevice (0);
+}
+
+void
+AnthocnetUnreachableTestCase::Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t iface)
+{
+  Ptr<Packet> copy = packet->Copy ();
+  Ipv4Header ip;
+  copy->RemoveHeader (ip);
+  if (ip.GetProtocol () != UdpL4Protocol::PROT_NUMBER)
+    {
+      return;
+    }
+
+  UdpHeader udp;
+  copy->RemoveHeader (udp);
+  if (udp.GetDestinationPort () != m_proto->GetConfig ()->ant_port)
+    {
+      return;
+    }
+
+  ahn::TypeHeader type;
+  copy->RemoveHeader (type);
+  if (type.IsValid () && type.Get () == ahn::AHNTYPE_FW_ANT)
+    {
+      m_antTimes.push_back (Simulator::Now ());
+    }
+}
+
+void
+AnthocnetUnreachableTestCase::Drop (const Ipv4Header &header, Ptr<const Packet> packet,
+                                    Ipv4L3Protocol::DropReason reason, Ptr<Ipv4> ipv4, uint32_t iface)
+{
+  if (reason == Ipv4L3Protocol::DROP_ROUTE_ERROR && header.GetDestination () == m_dst)
+    {
+      m_errorTimes.push_back (Simulator::Now ());
+    }
+}
+
+void
+AnthocnetUnreachableTestCase::DataDrop (Ptr<const Packet> packet, std::string reason, Ipv4Address src)
+{
+  if (reason == "Route discovery failed")
+    {
+      m_dropTimes.push_back (Simulator::Now ());
+    }
+}
+
+void
+AnthocnetUnreachableTestCase::DoRun (void)
+{
+  m_node = CreateObject<Node> ();
+  Ptr<SimpleChannel> channel = CreateObject<SimpleChannel> ();
+  m_proto = CreateAntHocNetNode (m_node, channel, Ipv4Address ("10.0.0.1"));
+
+  // No proactive ants in between, and the data outlives the discovery
+  Ptr<ahn::AntHocNetConfig> config = m_proto->GetConfig ();
+  config->SetAttribute ("ProactiveAntTimer", TimeValue (Seconds (100)));
+  config->SetAttribute ("DataCacheExpire", TimeValue (Seconds (10)));
+
+  m_node->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext ("Tx",
+    MakeCallback (&AnthocnetUnreachableTestCase::Tx, this));
+  m_node->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext ("Drop",
+    MakeCallback (&AnthocnetUnreachableTestCase::Drop, this));
+  m_proto->TraceConnectWithoutContext ("DataDrop",
+    MakeCallback (&AnthocnetUnreachableTestCase::DataDrop, this));
+
+  m_socket = Socket::CreateSocket (m_node, UdpSocketFactory::GetTypeId ());
+
+  Simulator::Schedule (Seconds (1.0), &AnthocnetUnreachableTestCase::Send, this);
+  Simulator::Schedule (Seconds (1.5), &AnthocnetUnreachableTestCase::CheckPending, this);
+  Simulator::Stop (Seconds (8.0));
+  Simulator::Run ();
+
+  // The first ant, and one per retry with a doubling backoff up to 2s
+  const double antTimes[] = { 1.0, 1.2, 1.6, 2.4, 4.0 };
+  NS_TEST_ASSERT_MSG_EQ (m_antTimes.size (), 5, "Wrong number of forward ants");
+  for (uint32_t i = 0; i < m_antTimes.size () && i < 5; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ_TOL (m_antTimes[i].GetSeconds (), antTimes[i], 1e-6,
+                                 "Forward ant " << i << " at the wrong time");
+    }
+
+  NS_TEST_ASSERT_MSG_EQ (m_loopback, true, "Data not held on the loopback during the discovery");
+
+  // Given up after DiscoveryMaxRetries, one backoff after the last ant
+  NS_TEST_ASSERT_MSG_EQ (m_dropTimes.size (), 3, "Cached data not dropped");
+  NS_TEST_ASSERT_MSG_EQ (m_errorTimes.size (), 3, "Error callback not invoked per packet");
+  for (uint32_t i = 0; i < m_dropTimes.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ_TOL (m_dropTimes[i].GetSeconds (), 6.0, 1e-6,
+                                 "Packet " << i << " dropped at the wrong time");
+    }
+  for (uint32_t i = 0; i < m_errorTimes.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ_TOL (m_errorTimes[i].GetSeconds (), 6.0, 1e-6,
+                                 "Error callback " << i << " at the wrong time");
+    }
+
+  m_socket->Close ();
+  m_socket = 0;
+  m_proto = 0;
+  m_node = 0;
+  Simulator::Destroy ();
+}
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
@@ -61,6 +1918,25 @@ AnthocnetTestSuite::AnthocnetTestSuite ()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new AnthocnetTestCase1, TestCase::QUICK);
+  AddTestCase (new AnthocnetAliasTableTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetHistoryWindowTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetBestPheromoneTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetEvaporationTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetHousekeepingTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetNeighborWheelTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetHelloDiffusionTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetFisMfTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetFisMissingFileTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetFisReferenceTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetFisLookupTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetOutcomeWindowTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetCacheExpiryTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetCacheDropPolicyTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetCacheRingTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetCachePacingTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetMacCacheTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetSniffParserTestCase, TestCase::QUICK);
+  AddTestCase (new AnthocnetUnreachableTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite